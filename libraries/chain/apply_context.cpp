@@ -554,27 +554,37 @@ uint32_t apply_context::schedule_action( action&& act_to_schedule, account_name
 }
 
 const table_id_object* apply_context::find_table( name code, name scope, name table ) {
-   return db.find<table_id_object, by_code_scope_table>(boost::make_tuple(code, scope, table));
+   auto key = std::make_tuple(code, scope, table);
+   auto itr = trx_context.table_lookups.find( key );
+   if( itr != trx_context.table_lookups.end() )
+      return itr->second;
+
+   const auto* tid = db.find<table_id_object, by_code_scope_table>(boost::make_tuple(code, scope, table));
+   trx_context.table_lookups.emplace( key, tid );
+   return tid;
 }
 
 const table_id_object& apply_context::find_or_create_table( name code, name scope, name table, const account_name &payer ) {
-   const auto* existing_tid =  db.find<table_id_object, by_code_scope_table>(boost::make_tuple(code, scope, table));
+   const auto* existing_tid = find_table( code, scope, table );
    if (existing_tid != nullptr) {
       return *existing_tid;
    }
 
    update_db_usage(payer, config::billable_size_v<table_id_object>);
 
-   return db.create<table_id_object>([&](table_id_object &t_id){
+   const auto& tid = db.create<table_id_object>([&](table_id_object &t_id){
       t_id.code = code;
       t_id.scope = scope;
       t_id.table = table;
       t_id.payer = payer;
    });
+   trx_context.table_lookups[std::make_tuple(code, scope, table)] = &tid;
+   return tid;
 }
 
 void apply_context::remove_table( const table_id_object& tid ) {
    update_db_usage(tid.payer, - config::billable_size_v<table_id_object>);
+   trx_context.table_lookups[std::make_tuple(tid.code, tid.scope, tid.table)] = nullptr;
    db.remove(tid);
 }
 
@@ -673,6 +683,8 @@ int apply_context::db_store_i64( uint64_t code, uint64_t scope, uint64_t table,
    int64_t billable_size = (int64_t)(buffer_size + config::billable_size_v<key_value_object>);
    update_db_usage( payer, billable_size);
 
+   trx_context.row_lookups[std::make_pair(tableid._id, id)] = &obj;
+
    keyval_cache.cache_table( tab );
    return keyval_cache.add( obj );
 }
@@ -720,6 +732,7 @@ void apply_context::db_remove_i64( int iterator ) {
    db.modify( table_obj, [&]( auto& t ) {
       --t.count;
    });
+   trx_context.row_lookups.erase( std::make_pair(obj.t_id._id, obj.primary_key) );
    db.remove( obj );
 
    if (table_obj.count == 0) {
@@ -796,9 +809,15 @@ int apply_context::db_find_i64( uint64_t code, uint64_t scope, uint64_t table, u
 
    auto table_end_itr = keyval_cache.cache_table( *tab );
 
+   const auto key = std::make_pair( tab->id._id, id );
+   auto cached = trx_context.row_lookups.find( key );
+   if( cached != trx_context.row_lookups.end() )
+      return keyval_cache.add( *cached->second );
+
    const key_value_object* obj = db.find<key_value_object, by_scope_primary>( boost::make_tuple( tab->id, id ) );
    if( !obj ) return table_end_itr;
 
+   trx_context.row_lookups.emplace( key, obj );
    return keyval_cache.add( *obj );
 }
 
@@ -4,8 +4,25 @@
  */
 #include <eosio/chain/block_log.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/thread_utils.hpp>
 #include <fstream>
 #include <fc/io/raw.hpp>
+#include <fc/log/logger_config.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #define LOG_READ  (std::ios::in | std::ios::binary)
 #define LOG_WRITE (std::ios::out | std::ios::binary | std::ios::app)
@@ -20,10 +37,534 @@ namespace eosio { namespace chain {
     * Version 1: complete block log from genesis
     * Version 2: adds optional partial block log, cannot be used for replay without snapshot
     *            this is in the form of an first_block_num that is written immediately after the version
+    * Version 3: each block entry starts with a one byte compression tag; zlib compressed entries hold the packed
+    *            block as a length prefixed byte vector. Only written when block log compression is enabled.
     */
-   const uint32_t block_log::max_supported_version = 2;
+   const uint32_t block_log::max_supported_version = 3;
+
+   namespace bio = boost::iostreams;
 
    namespace detail {
+      /**
+       * Read-only mappings of the log and index files. The files only grow at the end, so a mapping stays valid
+       * for every block it covers; when a reader needs a block past the end of the current mappings both files
+       * are mapped again and the old mappings are released once the last reader holding them lets go.
+       */
+      struct mapped_log_files {
+         boost::iostreams::mapped_file_source log;
+         boost::iostreams::mapped_file_source index;
+         uint32_t                             version = 0;
+
+         void open( const fc::path& log_file, const fc::path& index_file ) {
+            index.open( index_file.generic_string() );
+            log.open( log_file.generic_string() );
+            EOS_ASSERT( log.size() >= sizeof(version), block_log_exception, "Block log '${f}' has no header", ("f", log_file.generic_string()) );
+            memcpy( &version, log.data(), sizeof(version) );
+         }
+      };
+      using mapped_log_files_ptr = std::shared_ptr<const mapped_log_files>;
+
+      /// compression of a single block entry in a version 3 block log
+      enum class block_entry_compression : uint8_t {
+         none = 0,
+         zlib = 1
+      };
+
+      std::vector<char> zlib_compress_bytes( const std::vector<char>& data ) {
+         std::vector<char> out;
+         bio::filtering_ostream comp;
+         comp.push( bio::zlib_compressor( bio::zlib::best_speed ) );
+         comp.push( bio::back_inserter( out ) );
+         bio::write( comp, data.data(), data.size() );
+         bio::close( comp );
+         return out;
+      }
+
+      std::vector<char> zlib_decompress_bytes( const std::vector<char>& data ) {
+         std::vector<char> out;
+         bio::filtering_ostream decomp;
+         decomp.push( bio::zlib_decompressor() );
+         decomp.push( bio::back_inserter( out ) );
+         bio::write( decomp, data.data(), data.size() );
+         bio::close( decomp );
+         return out;
+      }
+
+      /// serialized block entry, without the trailing position, in the format of the given block log version
+      std::vector<char> pack_block_entry( const signed_block& b, uint32_t version, block_log_compression compression ) {
+         auto data = fc::raw::pack( b );
+         if( version < 3 )
+            return data;
+
+         if( compression == block_log_compression::zlib ) {
+            auto compressed = zlib_compress_bytes( data );
+            const size_t entry_size = 1 + fc::raw::pack_size( compressed );
+            // small blocks may not shrink, those are stored as they are
+            if( entry_size < data.size() + 1 ) {
+               std::vector<char> entry( entry_size );
+               fc::datastream<char*> ds( entry.data(), entry.size() );
+               fc::raw::pack( ds, static_cast<uint8_t>(block_entry_compression::zlib) );
+               fc::raw::pack( ds, compressed );
+               return entry;
+            }
+         }
+
+         std::vector<char> entry;
+         entry.reserve( data.size() + 1 );
+         entry.push_back( static_cast<char>(block_entry_compression::none) );
+         entry.insert( entry.end(), data.begin(), data.end() );
+         return entry;
+      }
+
+      /// reads one block entry written by pack_block_entry
+      template<typename Stream>
+      void unpack_block_entry( Stream& ds, uint32_t version, signed_block& b ) {
+         if( version < 3 ) {
+            fc::raw::unpack( ds, b );
+            return;
+         }
+
+         uint8_t tag = 0;
+         fc::raw::unpack( ds, tag );
+         switch( static_cast<block_entry_compression>(tag) ) {
+            case block_entry_compression::none:
+               fc::raw::unpack( ds, b );
+               break;
+            case block_entry_compression::zlib: {
+               std::vector<char> compressed;
+               fc::raw::unpack( ds, compressed );
+               const auto data = zlib_decompress_bytes( compressed );
+               fc::datastream<const char*> bds( data.data(), data.size() );
+               fc::raw::unpack( bds, b );
+               break;
+            }
+            default:
+               EOS_THROW( block_log_exception, "Unknown compression ${c} of block entry", ("c", tag) );
+         }
+      }
+
+      std::pair<signed_block_ptr, uint64_t> unpack_mapped_block( const mapped_log_files& m, uint64_t pos ) {
+         EOS_ASSERT( pos < m.log.size(), block_log_exception, "Block position ${pos} is past the end of the block log",
+                     ("pos", pos)("size", m.log.size()) );
+         fc::datastream<const char*> ds( m.log.data() + pos, m.log.size() - pos );
+         std::pair<signed_block_ptr,uint64_t> result;
+         result.first = std::make_shared<signed_block>();
+         unpack_block_entry( ds, m.version, *result.first );
+         result.second = pos + ds.tellp() + sizeof(uint64_t);
+         return result;
+      }
+
+      /// block number of the entry at the start of ds, decodes only the block header unless the entry is compressed
+      template<typename Stream>
+      uint32_t unpack_entry_block_num( Stream& ds, uint32_t version ) {
+         block_header h;
+         uint8_t tag = static_cast<uint8_t>(block_entry_compression::none);
+         if( version >= 3 )
+            fc::raw::unpack( ds, tag );
+         switch( static_cast<block_entry_compression>(tag) ) {
+            case block_entry_compression::none:
+               fc::raw::unpack( ds, h );
+               break;
+            case block_entry_compression::zlib: {
+               std::vector<char> compressed;
+               fc::raw::unpack( ds, compressed );
+               const auto data = zlib_decompress_bytes( compressed );
+               fc::datastream<const char*> bds( data.data(), data.size() );
+               fc::raw::unpack( bds, h );
+               break;
+            }
+            default:
+               EOS_THROW( block_log_exception, "Unknown compression ${c} of block entry", ("c", tag) );
+         }
+         return h.block_num();
+      }
+
+      void fsync_file( const fc::path& file ) {
+         const int fd = ::open( file.generic_string().c_str(), O_RDONLY );
+         EOS_ASSERT( fd >= 0, block_log_exception, "Unable to open ${f} for fsync: ${e}", ("f", file.generic_string())("e", strerror(errno)) );
+         const int r = ::fsync( fd );
+         const int err = errno;
+         ::close( fd );
+         EOS_ASSERT( r == 0, block_log_exception, "fsync of ${f} failed: ${e}", ("f", file.generic_string())("e", strerror(err)) );
+      }
+
+      uint64_t page_size() {
+         static const uint64_t size = sysconf( _SC_PAGESIZE );
+         return size;
+      }
+
+      /// file name stem of the stride file holding blocks [first_block_num, last_block_num]
+      std::string stride_file_stem( uint32_t first_block_num, uint32_t last_block_num ) {
+         return std::string("blocks-").append( std::to_string(first_block_num) ).append( "-" ).append( std::to_string(last_block_num) );
+      }
+
+      /// parses a file name of the form blocks-<first>-<last>.log
+      bool parse_stride_file_name( const std::string& name, uint32_t& first_block_num, uint32_t& last_block_num ) {
+         static const std::string prefix = "blocks-";
+         static const std::string suffix = ".log";
+         if( name.size() <= prefix.size() + suffix.size()
+             || name.compare( 0, prefix.size(), prefix ) != 0
+             || name.compare( name.size() - suffix.size(), suffix.size(), suffix ) != 0 )
+            return false;
+
+         const auto range = name.substr( prefix.size(), name.size() - prefix.size() - suffix.size() );
+         const auto dash = range.find( '-' );
+         if( dash == std::string::npos || dash == 0 || dash + 1 == range.size() )
+            return false;
+         const auto first = range.substr( 0, dash );
+         const auto last  = range.substr( dash + 1 );
+         if( first.size() > 10 || last.size() > 10
+             || first.find_first_not_of( "0123456789" ) != std::string::npos
+             || last.find_first_not_of( "0123456789" ) != std::string::npos )
+            return false;
+
+         const auto f = std::stoull( first );
+         const auto l = std::stoull( last );
+         if( f == 0 || f > l || l > std::numeric_limits<uint32_t>::max() )
+            return false;
+         first_block_num = f;
+         last_block_num  = l;
+         return true;
+      }
+
+      genesis_state extract_genesis_state_from_file( const fc::path& block_file ) {
+         std::fstream  block_stream;
+         block_stream.exceptions(std::fstream::failbit | std::fstream::badbit);
+         block_stream.open( block_file.generic_string().c_str(), LOG_READ );
+
+         uint32_t version = 0;
+         block_stream.read( (char*)&version, sizeof(version) );
+         EOS_ASSERT( version > 0, block_log_exception, "Block log was not setup properly." );
+         EOS_ASSERT( version >= block_log::min_supported_version && version <= block_log::max_supported_version, block_log_unsupported_version,
+                    "Unsupported version of block log. Block log version is ${version} while code supports version(s) [${min},${max}]",
+                    ("version", version)("min", block_log::min_supported_version)("max", block_log::max_supported_version) );
+
+         uint32_t first_block_num = 1;
+         if (version != 1) {
+            block_stream.read ( (char*)&first_block_num, sizeof(first_block_num) );
+         }
+
+         genesis_state gs;
+         fc::raw::unpack(block_stream, gs);
+         return gs;
+      }
+
+      /// true when both existing paths are on the same file system, so that a file moves between them by a rename
+      bool same_file_system( const fc::path& a, const fc::path& b ) {
+         struct stat sa, sb;
+         EOS_ASSERT( ::stat( a.generic_string().c_str(), &sa ) == 0 && ::stat( b.generic_string().c_str(), &sb ) == 0,
+                     block_log_exception, "Unable to stat '${a}' or '${b}': ${e}",
+                     ("a", a.generic_string())("b", b.generic_string())("e", strerror(errno)) );
+         return sa.st_dev == sb.st_dev;
+      }
+
+      /**
+       * Copies a file to another file system. The copy is made under a temporary name and renamed once it is complete
+       * and synced, so that an interrupted copy is never taken for a stride file.
+       */
+      void copy_complete_file( const fc::path& from, const fc::path& to ) {
+         const fc::path part( to.generic_string() + ".part" );
+         fc::remove_all( part );
+         fc::copy( from, part );
+         fsync_file( part );
+         fc::rename( part, to );
+      }
+
+      /// moves a file by a rename when it stays on the same file system, otherwise by a copy and unlink
+      void relocate_file( const fc::path& from, const fc::path& to ) {
+         if( same_file_system( from.parent_path(), to.parent_path() ) ) {
+            fc::rename( from, to );
+         } else {
+            copy_complete_file( from, to );
+            fc::remove( from );
+         }
+      }
+
+      /**
+       * The set of stride files that were rotated out of blocks.log, keyed by the first block number each holds.
+       * Stride files never change once written, so they are always read through read-only mappings; at most
+       * max_open_mappings of them are kept mapped at a time.
+       */
+      class block_log_catalog {
+         public:
+            struct entry {
+               uint32_t              first_block_num = 0;
+               uint32_t              last_block_num = 0;
+               fc::path              log_file;
+               fc::path              index_file;
+               mapped_log_files_ptr  mapped;
+               uint64_t              last_used = 0;
+            };
+
+            static constexpr size_t max_open_mappings = 16;
+
+            void open( const fc::path& dir, uint16_t index_threads );
+
+            bool     empty()const           { std::lock_guard<std::mutex> g( mtx ); return entries.empty(); }
+            uint32_t first_block_num()const { std::lock_guard<std::mutex> g( mtx ); return entries.empty() ? 0 : entries.begin()->first; }
+            uint32_t last_block_num()const  { std::lock_guard<std::mutex> g( mtx ); return entries.empty() ? 0 : entries.rbegin()->second.last_block_num; }
+            fc::path last_log_file()const   { std::lock_guard<std::mutex> g( mtx ); return entries.empty() ? fc::path() : entries.rbegin()->second.log_file; }
+
+            void add( uint32_t first_block_num, uint32_t last_block_num, const fc::path& log_file, const fc::path& index_file );
+            signed_block_ptr read_block_by_num( uint32_t block_num );
+
+            /// points the entry starting at first_block_num, if it is still in the catalog, at a new copy of its files
+            void relocate( uint32_t first_block_num, const fc::path& log_file, const fc::path& index_file );
+
+            /// removes the oldest entries until at most max_files remain and returns them for their files to be disposed of
+            std::vector<entry> retain( uint32_t max_files );
+            /// removes, like retain, the entries that only hold blocks before first_needed_block_num
+            std::vector<entry> prune( uint32_t first_needed_block_num );
+            void remove_all();
+
+         private:
+            mapped_log_files_ptr map_entry( entry& e );
+
+            mutable std::mutex          mtx;
+            std::map<uint32_t, entry>   entries;
+            uint64_t                    use_counter = 0;
+            size_t                      open_mappings = 0;
+      };
+
+      void block_log_catalog::open( const fc::path& dir, uint16_t index_threads ) {
+         std::lock_guard<std::mutex> g( mtx );
+         entries.clear();
+         open_mappings = 0;
+
+         for( fc::directory_iterator itr( dir ), end_itr; itr != end_itr; ++itr ) {
+            const fc::path p = *itr;
+            entry e;
+            if( !fc::is_regular_file( p ) || !parse_stride_file_name( p.filename().generic_string(), e.first_block_num, e.last_block_num ) )
+               continue;
+
+            e.log_file = p;
+            e.index_file = dir / stride_file_stem( e.first_block_num, e.last_block_num ).append( ".index" );
+            const uint64_t expected_index_size = sizeof(uint64_t) * (uint64_t(e.last_block_num) - e.first_block_num + 1);
+            if( !fc::exists( e.index_file ) || fc::file_size( e.index_file ) != expected_index_size ) {
+               ilog( "Index of stride file ${f} is missing or incomplete, reconstructing it", ("f", p.generic_string()) );
+               fc::remove_all( e.index_file );
+               block_log::construct_index( e.log_file, e.index_file, index_threads );
+            }
+            entries.emplace( e.first_block_num, std::move(e) );
+         }
+
+         uint32_t expected_first = 0;
+         for( const auto& item : entries ) {
+            EOS_ASSERT( expected_first == 0 || item.first == expected_first, block_log_exception,
+                        "Stride files in ${dir} are not contiguous: expected a file starting at block ${expected} but found one starting at ${first}",
+                        ("dir", dir.generic_string())("expected", expected_first)("first", item.first) );
+            expected_first = item.second.last_block_num + 1;
+         }
+
+         if( !entries.empty() )
+            ilog( "Found ${n} stride files holding blocks ${first} through ${last}",
+                  ("n", entries.size())("first", entries.begin()->first)("last", entries.rbegin()->second.last_block_num) );
+      }
+
+      void block_log_catalog::add( uint32_t first_block_num, uint32_t last_block_num, const fc::path& log_file, const fc::path& index_file ) {
+         std::lock_guard<std::mutex> g( mtx );
+         EOS_ASSERT( entries.empty() || entries.rbegin()->second.last_block_num + 1 == first_block_num, block_log_exception,
+                     "Stride file starting at block ${first} does not follow the last stride file", ("first", first_block_num) );
+         entry e;
+         e.first_block_num = first_block_num;
+         e.last_block_num = last_block_num;
+         e.log_file = log_file;
+         e.index_file = index_file;
+         entries.emplace( first_block_num, std::move(e) );
+      }
+
+      mapped_log_files_ptr block_log_catalog::map_entry( entry& e ) {
+         e.last_used = ++use_counter;
+         if( e.mapped )
+            return e.mapped;
+
+         auto m = std::make_shared<mapped_log_files>();
+         m->open( e.log_file, e.index_file );
+         EOS_ASSERT( m->index.size() == sizeof(uint64_t) * (uint64_t(e.last_block_num) - e.first_block_num + 1), block_log_exception,
+                     "Index ${f} does not match its stride file", ("f", e.index_file.generic_string()) );
+         e.mapped = std::move( m );
+
+         if( ++open_mappings > max_open_mappings ) {
+            entry* lru = nullptr;
+            for( auto& item : entries ) {
+               if( item.second.mapped && &item.second != &e && (!lru || item.second.last_used < lru->last_used) )
+                  lru = &item.second;
+            }
+            if( lru ) {
+               lru->mapped.reset();
+               --open_mappings;
+            }
+         }
+         return e.mapped;
+      }
+
+      signed_block_ptr block_log_catalog::read_block_by_num( uint32_t block_num ) {
+         mapped_log_files_ptr m;
+         uint64_t pos = 0;
+         {
+            std::lock_guard<std::mutex> g( mtx );
+            auto itr = entries.upper_bound( block_num );
+            if( itr == entries.begin() )
+               return {};
+            --itr;
+            auto& e = itr->second;
+            if( block_num > e.last_block_num )
+               return {};
+            m = map_entry( e );
+            memcpy( &pos, m->index.data() + sizeof(uint64_t) * (block_num - e.first_block_num), sizeof(pos) );
+         }
+         return unpack_mapped_block( *m, pos ).first;
+      }
+
+      void block_log_catalog::relocate( uint32_t first_block_num, const fc::path& log_file, const fc::path& index_file ) {
+         std::lock_guard<std::mutex> g( mtx );
+         auto itr = entries.find( first_block_num );
+         if( itr == entries.end() )
+            return;
+         // a mapping of the old files stays valid after they are unlinked
+         itr->second.log_file = log_file;
+         itr->second.index_file = index_file;
+      }
+
+      std::vector<block_log_catalog::entry> block_log_catalog::retain( uint32_t max_files ) {
+         std::lock_guard<std::mutex> g( mtx );
+         std::vector<entry> expired;
+         while( entries.size() > max_files ) {
+            auto itr = entries.begin();
+            if( itr->second.mapped )
+               --open_mappings;
+            expired.emplace_back( std::move(itr->second) );
+            entries.erase( itr );
+         }
+         return expired;
+      }
+
+      std::vector<block_log_catalog::entry> block_log_catalog::prune( uint32_t first_needed_block_num ) {
+         std::lock_guard<std::mutex> g( mtx );
+         std::vector<entry> expired;
+         while( !entries.empty() && entries.begin()->second.last_block_num < first_needed_block_num ) {
+            auto itr = entries.begin();
+            if( itr->second.mapped )
+               --open_mappings;
+            expired.emplace_back( std::move(itr->second) );
+            entries.erase( itr );
+         }
+         return expired;
+      }
+
+      void block_log_catalog::remove_all() {
+         std::lock_guard<std::mutex> g( mtx );
+         for( auto& item : entries ) {
+            fc::remove_all( item.second.log_file );
+            fc::remove_all( item.second.index_file );
+         }
+         entries.clear();
+         open_mappings = 0;
+      }
+
+      /**
+       * LRU cache of deserialized blocks keyed by block number, bounded by the serialized size of the blocks. A block
+       * number maps to one block only as long as the log does, so every append drops the cached blocks from its number
+       * on and a cached block with another id is replaced.
+       */
+      class block_cache {
+         public:
+            void set_capacity( uint64_t bytes ) {
+               std::lock_guard<std::mutex> g( mtx );
+               capacity = bytes;
+               evict();
+            }
+
+            signed_block_ptr get( uint32_t block_num ) {
+               std::lock_guard<std::mutex> g( mtx );
+               if( capacity == 0 )
+                  return {};
+               auto itr = index.find( block_num );
+               if( itr == index.end() ) {
+                  ++stats.misses;
+                  return {};
+               }
+               ++stats.hits;
+               lru.splice( lru.begin(), lru, itr->second );
+               return itr->second->block;
+            }
+
+            void put( const signed_block_ptr& b ) {
+               std::lock_guard<std::mutex> g( mtx );
+               if( capacity == 0 )
+                  return;
+               auto itr = index.find( b->block_num() );
+               if( itr != index.end() ) {
+                  if( itr->second->block == b || itr->second->block->id() == b->id() )
+                     return;
+                  stats.size -= itr->second->size;
+                  lru.erase( itr->second );
+                  index.erase( itr );
+               }
+               const uint64_t size = fc::raw::pack_size( *b );
+               if( size > capacity )
+                  return;
+               lru.push_front( entry{ b, size } );
+               index.emplace( b->block_num(), lru.begin() );
+               stats.size += size;
+               evict();
+            }
+
+            /// drops blocks that a block appended as block_num replaces
+            void remove_from( uint32_t block_num ) {
+               std::lock_guard<std::mutex> g( mtx );
+               for( auto itr = index.lower_bound( block_num ); itr != index.end(); itr = index.erase( itr ) ) {
+                  stats.size -= itr->second->size;
+                  lru.erase( itr->second );
+               }
+            }
+
+            /// drops blocks that are no longer in the block log
+            void remove_before( uint32_t block_num ) {
+               std::lock_guard<std::mutex> g( mtx );
+               const auto end = index.lower_bound( block_num );
+               for( auto itr = index.begin(); itr != end; ++itr ) {
+                  stats.size -= itr->second->size;
+                  lru.erase( itr->second );
+               }
+               index.erase( index.begin(), end );
+            }
+
+            void clear() {
+               std::lock_guard<std::mutex> g( mtx );
+               lru.clear();
+               index.clear();
+               stats.size = 0;
+            }
+
+            block_log_cache_stats get_stats()const {
+               std::lock_guard<std::mutex> g( mtx );
+               auto result = stats;
+               result.blocks = index.size();
+               return result;
+            }
+
+         private:
+            struct entry {
+               signed_block_ptr block;
+               uint64_t         size = 0;
+            };
+
+            void evict() {
+               while( stats.size > capacity && !lru.empty() ) {
+                  stats.size -= lru.back().size;
+                  index.erase( lru.back().block->block_num() );
+                  lru.pop_back();
+               }
+            }
+
+            mutable std::mutex                                         mtx;
+            uint64_t                                                   capacity = 0;
+            std::list<entry>                                           lru; ///< most recently used first
+            std::map<uint32_t, std::list<entry>::iterator>             index; ///< ordered so that pruned and replaced blocks are a prefix and a suffix
+            block_log_cache_stats                                      stats;
+      };
+
       class block_log_impl {
          public:
             signed_block_ptr         head;
@@ -32,10 +573,37 @@ namespace eosio { namespace chain {
             std::fstream             index_stream;
             fc::path                 block_file;
             fc::path                 index_file;
+            fc::path                 retained_dir;
+            bool                     retained_on_block_fs = true; ///< stride files are renamed into retained_dir on rotation
             bool                     open_files = false;
             bool                     genesis_written_to_block_log = false;
             uint32_t                 version = 0;
-            uint32_t                 first_block_num = 0;
+            bool                     version_pending = false; ///< the header of blocks.log still holds version 0
+            uint32_t                 first_block_num = 0; ///< first block of blocks.log, changes on rotation under mapped_mtx
+            genesis_state            genesis;
+            block_log_config         cfg;
+            block_log_catalog        catalog;
+            block_cache              cache;
+
+            /// number of the last block that is completely flushed to disk; 0 if there is none
+            std::atomic<uint32_t>    readable_head_num{0};
+            std::mutex               mapped_mtx;
+            mapped_log_files_ptr     mapped;
+            /// serializes use of block_stream and index_stream by reading threads and the thread appending blocks
+            std::mutex               stream_mtx;
+
+            /// blocks queued by an asynchronous append; they stay queued until written so that readers still find them
+            std::deque<signed_block_ptr> pending;
+            std::mutex               pending_mtx;
+            std::condition_variable  pending_cv;  ///< signals the writer thread
+            std::condition_variable  written_cv;  ///< signals threads waiting for pending to shrink
+            std::thread              writer_thread;
+            bool                     writer_stopping = false;
+            std::exception_ptr       writer_error;
+            uint32_t                 next_pending_num = 0;
+
+            /// copies stride files to another file system, archives and deletes them, off the thread appending blocks
+            fc::optional<named_thread_pool> file_pool;
 
             inline void check_open_files() {
                if( !open_files ) {
@@ -50,9 +618,145 @@ namespace eosio { namespace chain {
                if( index_stream.is_open() )
                   index_stream.close();
                open_files = false;
+               reset_mapped();
+            }
+
+            void reset_mapped() {
+               std::lock_guard<std::mutex> g( mapped_mtx );
+               mapped.reset();
+            }
+
+            void set_readable_head( uint32_t block_num ) {
+               readable_head_num.store( block_num, std::memory_order_release );
             }
+
+            /// version 3 is only used when compression is enabled so that uncompressed logs stay readable by older tools
+            uint32_t version_for_new_file()const {
+               return cfg.compression == block_log_compression::none ? 2 : 3;
+            }
+
+            /// first block a pruned log must keep when its head is head_num
+            uint32_t first_needed_block_num( uint32_t head_num )const {
+               return head_num >= cfg.prune_blocks ? head_num - cfg.prune_blocks + 1 : 1;
+            }
+
+            void write_header();
+            void write_version();
+            uint64_t write_blocks( const std::vector<signed_block_ptr>& blocks );
+            void rotate( uint32_t last_block_num );
+
+            void start_file_thread();
+            void stop_file_thread();
+            void post_file_job( std::function<void()> job );
+            void move_to_retained_dir( uint32_t first_block_num, uint32_t last_block_num );
+            void dispose( const std::vector<block_log_catalog::entry>& expired );
+            void retire( std::vector<block_log_catalog::entry> expired );
+
+            void start_writer();
+            void stop_writer();
+            void run_writer();
+            void enqueue( const signed_block_ptr& b );
+            void wait_until_written();
+            signed_block_ptr read_pending( uint32_t block_num );
+
+            std::pair<signed_block_ptr, uint64_t> read_stream_block( uint64_t pos );
+            signed_block_ptr read_stream_block_by_num( uint32_t block_num );
+            /// @pre stream_mtx is held
+            uint64_t read_stream_block_pos( uint32_t block_num );
+            /// @pre stream_mtx is held
+            std::pair<signed_block_ptr, uint64_t> unpack_stream_block( uint64_t pos );
+
+            /// @pre mapped_mtx is held
+            const mapped_log_files_ptr& get_mapped( uint64_t min_log_size, uint64_t min_index_size );
+            uint64_t read_mapped_block_pos( uint32_t block_num );
+            std::pair<signed_block_ptr, uint64_t> read_mapped_block( uint64_t pos );
+            signed_block_ptr read_mapped_block_by_num( uint32_t block_num );
       };
 
+      std::pair<signed_block_ptr, uint64_t> block_log_impl::read_stream_block( uint64_t pos ) {
+         std::lock_guard<std::mutex> g( stream_mtx );
+         return unpack_stream_block( pos );
+      }
+
+      signed_block_ptr block_log_impl::read_stream_block_by_num( uint32_t block_num ) {
+         std::lock_guard<std::mutex> g( stream_mtx );
+         const uint64_t pos = read_stream_block_pos( block_num );
+         if( pos == block_log::npos )
+            return {};
+         return unpack_stream_block( pos ).first;
+      }
+
+      uint64_t block_log_impl::read_stream_block_pos( uint32_t block_num ) {
+         check_open_files();
+         if( block_num < first_block_num || block_num > readable_head_num.load( std::memory_order_acquire ) )
+            return block_log::npos;
+         index_stream.seekg(sizeof(uint64_t) * (block_num - first_block_num));
+         uint64_t pos;
+         index_stream.read((char*)&pos, sizeof(pos));
+         return pos;
+      }
+
+      std::pair<signed_block_ptr, uint64_t> block_log_impl::unpack_stream_block( uint64_t pos ) {
+         check_open_files();
+
+         block_stream.seekg(pos);
+         std::pair<signed_block_ptr,uint64_t> result;
+         result.first = std::make_shared<signed_block>();
+         unpack_block_entry(block_stream, version, *result.first);
+         result.second = uint64_t(block_stream.tellg()) + 8;
+         return result;
+      }
+
+      const mapped_log_files_ptr& block_log_impl::get_mapped( uint64_t min_log_size, uint64_t min_index_size ) {
+         if( !mapped || mapped->log.size() < min_log_size || mapped->index.size() < min_index_size ) {
+            auto m = std::make_shared<mapped_log_files>();
+            m->open( block_file, index_file );
+            EOS_ASSERT( m->log.size() >= min_log_size && m->index.size() >= min_index_size, block_log_exception,
+                        "Block log files are shorter than expected",
+                        ("log_size", m->log.size())("index_size", m->index.size())
+                        ("expected_log_size", min_log_size)("expected_index_size", min_index_size) );
+            mapped = std::move( m );
+         }
+         return mapped;
+      }
+
+      uint64_t block_log_impl::read_mapped_block_pos( uint32_t block_num ) {
+         std::lock_guard<std::mutex> g( mapped_mtx );
+         const uint32_t head_num = readable_head_num.load( std::memory_order_acquire );
+         if( block_num < first_block_num || block_num > head_num )
+            return block_log::npos;
+         const uint64_t index_offset = sizeof(uint64_t) * (block_num - first_block_num);
+         const auto& m = get_mapped( 0, index_offset + sizeof(uint64_t) );
+         uint64_t pos;
+         memcpy( &pos, m->index.data() + index_offset, sizeof(pos) );
+         return pos;
+      }
+
+      std::pair<signed_block_ptr, uint64_t> block_log_impl::read_mapped_block( uint64_t pos ) {
+         mapped_log_files_ptr m;
+         {
+            std::lock_guard<std::mutex> g( mapped_mtx );
+            m = get_mapped( pos + 1, 0 );
+         }
+         return unpack_mapped_block( *m, pos );
+      }
+
+      signed_block_ptr block_log_impl::read_mapped_block_by_num( uint32_t block_num ) {
+         mapped_log_files_ptr m;
+         uint64_t pos = 0;
+         {
+            // the position and the mapping it refers to must come from the same file
+            std::lock_guard<std::mutex> g( mapped_mtx );
+            const uint32_t head_num = readable_head_num.load( std::memory_order_acquire );
+            if( block_num < first_block_num || block_num > head_num )
+               return {};
+            const uint64_t index_offset = sizeof(uint64_t) * (block_num - first_block_num);
+            m = get_mapped( 0, index_offset + sizeof(uint64_t) );
+            memcpy( &pos, m->index.data() + index_offset, sizeof(pos) );
+         }
+         return unpack_mapped_block( *m, pos ).first;
+      }
+
       void block_log_impl::reopen() {
          close();
 
@@ -68,13 +772,281 @@ namespace eosio { namespace chain {
 
          open_files = true;
       }
+
+      /// writes the header of a new blocks.log that holds no blocks yet; blocks.log must be empty
+      void block_log_impl::write_header() {
+         check_open_files();
+
+         auto data = fc::raw::pack(genesis);
+         const uint32_t header_version = version_pending ? 0 : version;
+         block_stream.seekp(0, std::ios::end);
+         block_stream.write((char*)&header_version, sizeof(header_version));
+         block_stream.write((char*)&first_block_num, sizeof(first_block_num));
+         block_stream.write(data.data(), data.size());
+
+         // append a totem to indicate the division between blocks and header
+         auto totem = block_log::npos;
+         block_stream.write((char*)&totem, sizeof(totem));
+         block_stream.flush();
+         genesis_written_to_block_log = true;
+      }
+
+      /// replaces the version 0 that write_header left in blocks.log while version_pending
+      void block_log_impl::write_version() {
+         block_stream.seekp( 0 );
+         block_stream.write( (char*)&version, sizeof(version) );
+         block_stream.seekp( 0, std::ios::end );
+         version_pending = false;
+      }
+
+      /// appends the blocks with one write to each file, returns the position of the first block
+      uint64_t block_log_impl::write_blocks( const std::vector<signed_block_ptr>& blocks ) {
+         std::lock_guard<std::mutex> g( stream_mtx );
+         check_open_files();
+
+         block_stream.seekp(0, std::ios::end);
+         index_stream.seekp(0, std::ios::end);
+         const uint64_t first_pos = block_stream.tellp();
+         EOS_ASSERT(index_stream.tellp() == sizeof(uint64_t) * (blocks.front()->block_num() - first_block_num),
+                   block_log_append_fail,
+                   "Append to index file occuring at wrong position.",
+                   ("position", (uint64_t) index_stream.tellp())
+                   ("expected", (blocks.front()->block_num() - first_block_num) * sizeof(uint64_t)));
+
+         std::vector<char> log_data;
+         std::vector<char> index_data( sizeof(uint64_t) * blocks.size() );
+         uint64_t pos = first_pos;
+         for( size_t i = 0; i < blocks.size(); ++i ) {
+            auto data = pack_block_entry(*blocks[i], version, cfg.compression);
+            log_data.insert( log_data.end(), data.begin(), data.end() );
+            log_data.insert( log_data.end(), (const char*)&pos, (const char*)&pos + sizeof(pos) );
+            memcpy( index_data.data() + sizeof(uint64_t) * i, &pos, sizeof(pos) );
+            pos += data.size() + sizeof(pos);
+         }
+         block_stream.write(log_data.data(), log_data.size());
+         index_stream.write(index_data.data(), index_data.size());
+         if( version_pending )
+            write_version();
+         block_stream.flush();
+         index_stream.flush();
+
+         if( cfg.fsync_appends ) {
+            fsync_file( block_file );
+            fsync_file( index_file );
+         }
+         return first_pos;
+      }
+
+      void block_log_impl::start_file_thread() {
+         if( !file_pool )
+            file_pool.emplace( "blkfile", 1 );
+      }
+
+      /// waits for the jobs posted so far, then joins the file thread
+      void block_log_impl::stop_file_thread() {
+         if( !file_pool )
+            return;
+         async_thread_pool( file_pool->get_executor(), []() {} ).wait();
+         file_pool.reset();
+      }
+
+      /// jobs run one at a time in the order they were posted; stride files a failed job leaves behind are moved on the next open
+      void block_log_impl::post_file_job( std::function<void()> job ) {
+         boost::asio::post( file_pool->get_executor(), [job{std::move(job)}]() {
+            try {
+               job();
+            } FC_LOG_AND_DROP();
+         } );
+      }
+
+      /// copies a stride file that rotate left in the blocks directory to retained_dir, on another file system
+      void block_log_impl::move_to_retained_dir( uint32_t first_block_num, uint32_t last_block_num ) {
+         const auto stem = stride_file_stem( first_block_num, last_block_num );
+         const auto log_file = block_file.parent_path() / (stem + ".log");
+         const auto index_file = block_file.parent_path() / (stem + ".index");
+         const auto retained_log = retained_dir / (stem + ".log");
+         const auto retained_index = retained_dir / (stem + ".index");
+         copy_complete_file( log_file, retained_log );
+         copy_complete_file( index_file, retained_index );
+         catalog.relocate( first_block_num, retained_log, retained_index );
+         fc::remove( log_file );
+         fc::remove( index_file );
+      }
+
+      void block_log_impl::dispose( const std::vector<block_log_catalog::entry>& expired ) {
+         // readers still holding a mapping of an expired file keep reading the unlinked file
+         for( const auto& e : expired ) {
+            // jobs run in order, so a file copied to retained_dir after rotation has arrived there by now
+            const auto log_file = retained_dir / e.log_file.filename();
+            const auto index_file = retained_dir / e.index_file.filename();
+            if( cfg.archive_dir.empty() ) {
+               ilog( "Removing stride file ${f}", ("f", log_file.generic_string()) );
+               fc::remove( log_file );
+               fc::remove( index_file );
+            } else {
+               ilog( "Moving stride file ${f} to ${dir}", ("f", log_file.generic_string())("dir", cfg.archive_dir.generic_string()) );
+               relocate_file( log_file, cfg.archive_dir / log_file.filename() );
+               relocate_file( index_file, cfg.archive_dir / index_file.filename() );
+            }
+         }
+      }
+
+      void block_log_impl::retire( std::vector<block_log_catalog::entry> expired ) {
+         if( expired.empty() )
+            return;
+         post_file_job( [this, expired{std::move(expired)}]() { dispose( expired ); } );
+      }
+
+      void block_log_impl::start_writer() {
+         if( !cfg.async_append || writer_thread.joinable() )
+            return;
+         writer_stopping = false;
+         writer_error = nullptr;
+         next_pending_num = head ? head->block_num() + 1 : first_block_num;
+         writer_thread = std::thread( [this]() { run_writer(); } );
+      }
+
+      /// drains the queue unless the writer failed, then joins the writer thread
+      void block_log_impl::stop_writer() {
+         if( !writer_thread.joinable() )
+            return;
+         {
+            std::lock_guard<std::mutex> g( pending_mtx );
+            writer_stopping = true;
+         }
+         pending_cv.notify_all();
+         writer_thread.join();
+         if( writer_error && !pending.empty() )
+            elog( "Block log writer failed, ${n} queued blocks were not written; they are appended from the reversible blocks on restart",
+                  ("n", pending.size()) );
+         pending.clear();
+      }
+
+      void block_log_impl::run_writer() {
+         fc::set_os_thread_name( "blklog" );
+         std::vector<signed_block_ptr> batch;
+         while( true ) {
+            batch.clear();
+            {
+               std::unique_lock<std::mutex> g( pending_mtx );
+               pending_cv.wait( g, [&]() { return writer_stopping || !pending.empty(); } );
+               if( pending.empty() )
+                  return;
+               // everything queued so far goes into one write, up to the end of the current stride
+               for( const auto& b : pending ) {
+                  batch.push_back( b );
+                  if( cfg.stride && b->block_num() % cfg.stride == 0 )
+                     break;
+               }
+            }
+
+            try {
+               write_blocks( batch );
+               const uint32_t last_block_num = batch.back()->block_num();
+               set_readable_head( last_block_num );
+               if( cfg.stride && last_block_num % cfg.stride == 0 )
+                  rotate( last_block_num );
+            } catch( ... ) {
+               elog( "Unable to write blocks ${first} through ${last} to the block log",
+                     ("first", batch.front()->block_num())("last", batch.back()->block_num()) );
+               std::lock_guard<std::mutex> g( pending_mtx );
+               writer_error = std::current_exception();
+               written_cv.notify_all();
+               return;
+            }
+
+            {
+               std::lock_guard<std::mutex> g( pending_mtx );
+               pending.erase( pending.begin(), pending.begin() + batch.size() );
+            }
+            written_cv.notify_all();
+         }
+      }
+
+      void block_log_impl::enqueue( const signed_block_ptr& b ) {
+         std::unique_lock<std::mutex> g( pending_mtx );
+         written_cv.wait( g, [&]() { return pending.size() < cfg.max_pending_blocks || writer_error; } );
+         if( writer_error )
+            std::rethrow_exception( writer_error );
+         EOS_ASSERT( b->block_num() == next_pending_num, block_log_append_fail,
+                     "Append of block ${n} out of order, expected block ${expected}", ("n", b->block_num())("expected", next_pending_num) );
+         pending.push_back( b );
+         ++next_pending_num;
+         pending_cv.notify_one();
+      }
+
+      void block_log_impl::wait_until_written() {
+         if( !writer_thread.joinable() )
+            return;
+         std::unique_lock<std::mutex> g( pending_mtx );
+         written_cv.wait( g, [&]() { return pending.empty() || writer_error; } );
+         if( writer_error )
+            std::rethrow_exception( writer_error );
+      }
+
+      signed_block_ptr block_log_impl::read_pending( uint32_t block_num ) {
+         std::lock_guard<std::mutex> g( pending_mtx );
+         if( pending.empty() || block_num < pending.front()->block_num() )
+            return {};
+         const uint32_t offset = block_num - pending.front()->block_num();
+         return offset < pending.size() ? pending[offset] : signed_block_ptr();
+      }
+
+      /**
+       * Moves blocks.log and blocks.index into the retained directory as a stride file and starts a new blocks.log
+       * beginning right after the current head. When the retained directory is on another file system the stride
+       * file is renamed within the blocks directory and copied over by the file thread.
+       */
+      void block_log_impl::rotate( uint32_t last_block_num ) {
+         const auto stem = stride_file_stem( first_block_num, last_block_num );
+         const fc::path dir = retained_on_block_fs ? retained_dir : block_file.parent_path();
+         const auto retained_log = dir / (stem + ".log");
+         const auto retained_index = dir / (stem + ".index");
+         EOS_ASSERT( !fc::exists(retained_log) && !fc::exists(retained_index), block_log_exception,
+                     "Stride file '${f}' already exists", ("f", retained_log.generic_string()) );
+
+         ilog( "Rotating block log: blocks ${first} through ${last} moved to '${f}'",
+               ("first", first_block_num)("last", last_block_num)("f", retained_log.generic_string()) );
+         const uint32_t rotated_first_block_num = first_block_num;
+
+         std::unique_lock<std::mutex> stream_lock( stream_mtx );
+         {
+            // readers must see the blocks in either blocks.log or the catalog, never in neither
+            std::lock_guard<std::mutex> g( mapped_mtx );
+            if( block_stream.is_open() )
+               block_stream.close();
+            if( index_stream.is_open() )
+               index_stream.close();
+            open_files = false;
+            mapped.reset();
+
+            fc::rename( block_file, retained_log );
+            fc::rename( index_file, retained_index );
+            catalog.add( first_block_num, last_block_num, retained_log, retained_index );
+            first_block_num = last_block_num + 1;
+         }
+
+         version = version_for_new_file();
+         reopen();
+         write_header();
+         stream_lock.unlock();
+
+         if( !retained_on_block_fs )
+            post_file_job( [this, rotated_first_block_num, last_block_num]() {
+               move_to_retained_dir( rotated_first_block_num, last_block_num );
+            } );
+         retire( catalog.retain( cfg.max_retained_files ) );
+         if( cfg.prune_blocks )
+            retire( catalog.prune( first_needed_block_num( last_block_num ) ) );
+         cache.remove_before( catalog.empty() ? first_block_num : catalog.first_block_num() );
+      }
    }
 
-   block_log::block_log(const fc::path& data_dir)
+   block_log::block_log(const fc::path& data_dir, const block_log_config& cfg)
    :my(new detail::block_log_impl()) {
       my->block_stream.exceptions(std::fstream::failbit | std::fstream::badbit);
       my->index_stream.exceptions(std::fstream::failbit | std::fstream::badbit);
-      open(data_dir);
+      open(data_dir, cfg);
    }
 
    block_log::block_log(block_log&& other) {
@@ -83,14 +1055,28 @@ namespace eosio { namespace chain {
 
    block_log::~block_log() {
       if (my) {
+         my->stop_writer();
+         my->stop_file_thread();
          flush();
          my->close();
          my.reset();
       }
    }
 
-   void block_log::open(const fc::path& data_dir) {
+   void block_log::open(const fc::path& data_dir, const block_log_config& cfg) {
+      my->stop_writer();
+      my->stop_file_thread();
       my->close();
+      my->cfg = cfg;
+      if( cfg.async_append )
+         my->cfg.mmap_reads = true;
+      // pruning works by dropping whole stride files
+      EOS_ASSERT( !cfg.prune_blocks || cfg.stride, block_log_exception,
+                  "Pruning the block log to ${n} blocks requires a stride", ("n", cfg.prune_blocks) );
+      my->set_readable_head( 0 );
+      my->version_pending = false;
+      my->cache.clear();
+      my->cache.set_capacity( cfg.cache_size );
 
       if (!fc::is_directory(data_dir))
          fc::create_directories(data_dir);
@@ -98,6 +1084,29 @@ namespace eosio { namespace chain {
       my->block_file = data_dir / "blocks.log";
       my->index_file = data_dir / "blocks.index";
 
+      my->retained_dir = cfg.retained_dir.empty() ? data_dir : cfg.retained_dir;
+      if (!fc::is_directory(my->retained_dir))
+         fc::create_directories(my->retained_dir);
+      if (!cfg.archive_dir.empty() && !fc::is_directory(cfg.archive_dir))
+         fc::create_directories(cfg.archive_dir);
+      my->retained_on_block_fs = detail::same_file_system( data_dir, my->retained_dir );
+      if( fc::canonical( data_dir ) != fc::canonical( my->retained_dir ) ) {
+         // stride files whose copy to another file system was interrupted, or rotated before retained_dir was set
+         for( fc::directory_iterator itr( data_dir ), end_itr; itr != end_itr; ++itr ) {
+            const fc::path p = *itr;
+            uint32_t first = 0, last = 0;
+            if( !fc::is_regular_file( p ) || !detail::parse_stride_file_name( p.filename().generic_string(), first, last ) )
+               continue;
+            ilog( "Moving stride file ${f} to ${dir}", ("f", p.generic_string())("dir", my->retained_dir.generic_string()) );
+            const auto index = data_dir / detail::stride_file_stem( first, last ).append( ".index" );
+            if( fc::exists( index ) )
+               detail::relocate_file( index, my->retained_dir / index.filename() );
+            detail::relocate_file( p, my->retained_dir / p.filename() );
+         }
+      }
+      my->catalog.open(my->retained_dir, cfg.index_threads);
+      my->dispose( my->catalog.retain(cfg.max_retained_files) );
+
       my->reopen();
 
       /* On startup of the block log, there are several states the log file and the index file can be
@@ -140,6 +1149,17 @@ namespace eosio { namespace chain {
          } else {
             my->first_block_num = 1;
          }
+         fc::raw::unpack(my->block_stream, my->genesis);
+
+         if (my->version < 3 && my->cfg.compression != block_log_compression::none)
+            wlog("Block log version ${v} does not support compression, new blocks are stored uncompressed until blocks.log is rotated or reset",
+                 ("v", my->version));
+
+         if (!my->catalog.empty()) {
+            EOS_ASSERT(my->catalog.last_block_num() + 1 == my->first_block_num, block_log_exception,
+                       "The last stride file ends at block ${last} but blocks.log starts at block ${first}",
+                       ("last", my->catalog.last_block_num())("first", my->first_block_num));
+         }
 
          my->head = read_head();
          if( my->head ) {
@@ -175,30 +1195,48 @@ namespace eosio { namespace chain {
          fc::remove_all(my->index_file);
          my->reopen();
       }
+
+      if (!log_size && !my->catalog.empty()) {
+         // a rotation was interrupted before the new blocks.log was written; start it after the last stride file
+         ilog("Log is empty, starting it after the last stride file");
+         my->genesis = detail::extract_genesis_state_from_file(my->catalog.last_log_file());
+         my->version = my->version_for_new_file();
+         my->first_block_num = my->catalog.last_block_num() + 1;
+         my->write_header();
+         my->head = read_head();
+         my->head_id = my->head->id();
+      }
+
+      if( my->head )
+         my->set_readable_head( my->head->block_num() );
+      if( my->cfg.prune_blocks && my->head )
+         my->dispose( my->catalog.prune( my->first_needed_block_num( my->head->block_num() ) ) );
+      my->start_file_thread();
+      my->start_writer();
    }
 
    uint64_t block_log::append(const signed_block_ptr& b) {
       try {
          EOS_ASSERT( my->genesis_written_to_block_log, block_log_append_fail, "Cannot append to block log until the genesis is first written" );
 
-         my->check_open_files();
+         if( my->writer_thread.joinable() ) {
+            my->enqueue( b );
+            my->head = b;
+            my->head_id = b->id();
+            my->cache.remove_from( b->block_num() );
+            my->cache.put( b );
+            return npos;
+         }
 
-         my->block_stream.seekp(0, std::ios::end);
-         my->index_stream.seekp(0, std::ios::end);
-         uint64_t pos = my->block_stream.tellp();
-         EOS_ASSERT(my->index_stream.tellp() == sizeof(uint64_t) * (b->block_num() - my->first_block_num),
-                   block_log_append_fail,
-                   "Append to index file occuring at wrong position.",
-                   ("position", (uint64_t) my->index_stream.tellp())
-                   ("expected", (b->block_num() - my->first_block_num) * sizeof(uint64_t)));
-         auto data = fc::raw::pack(*b);
-         my->block_stream.write(data.data(), data.size());
-         my->block_stream.write((char*)&pos, sizeof(pos));
-         my->index_stream.write((char*)&pos, sizeof(pos));
+         uint64_t pos = my->write_blocks( {b} );
          my->head = b;
          my->head_id = b->id();
+         my->set_readable_head( b->block_num() );
+         my->cache.remove_from( b->block_num() );
+         my->cache.put( b );
 
-         flush();
+         if( my->cfg.stride && b->block_num() % my->cfg.stride == 0 )
+            my->rotate( b->block_num() );
 
          return pos;
       }
@@ -206,83 +1244,96 @@ namespace eosio { namespace chain {
    }
 
    void block_log::flush() {
+      if( my->writer_thread.joinable() ) {
+         my->wait_until_written();
+         return;
+      }
+      std::lock_guard<std::mutex> g( my->stream_mtx );
       my->block_stream.flush();
       my->index_stream.flush();
    }
 
    void block_log::reset( const genesis_state& gs, const signed_block_ptr& first_block, uint32_t first_block_num ) {
+      my->stop_writer();
+      my->stop_file_thread();
       my->close();
+      my->cache.clear();
+      my->set_readable_head( 0 );
 
+      if (!my->catalog.empty()) {
+         wlog("Resetting block log, removing stride files in '${dir}'", ("dir", my->retained_dir.generic_string()));
+         my->catalog.remove_all();
+      }
       fc::remove_all(my->block_file);
       fc::remove_all(my->index_file);
 
       my->reopen();
+      my->start_file_thread();
 
-      auto data = fc::raw::pack(gs);
-      my->version = 0; // version of 0 is invalid; it indicates that the genesis was not properly written to the block log
+      my->genesis = gs;
+      // blocks are packed for the final version, but the header holds version 0 until the first block is written
+      // or the reset completes; version of 0 is invalid; it indicates that the genesis was not properly written to the block log
+      my->version = my->version_for_new_file();
+      my->version_pending = true;
       my->first_block_num = first_block_num;
-      my->block_stream.seekp(0, std::ios::end);
-      my->block_stream.write((char*)&my->version, sizeof(my->version));
-      my->block_stream.write((char*)&my->first_block_num, sizeof(my->first_block_num));
-      my->block_stream.write(data.data(), data.size());
-      my->genesis_written_to_block_log = true;
-
-      // append a totem to indicate the division between blocks and header
-      auto totem = npos;
-      my->block_stream.write((char*)&totem, sizeof(totem));
+      my->write_header();
+      my->head.reset();
+      my->head_id = {};
 
       if (first_block) {
-         append(first_block);
-      } else {
-         my->head.reset();
-         my->head_id = {};
+         append(first_block); // the writer thread is not started yet, so the block and the version are written here
       }
 
-      auto pos = my->block_stream.tellp();
-
-      static_assert( block_log::max_supported_version > 0, "a version number of zero is not supported" );
-      my->version = block_log::max_supported_version;
-      my->block_stream.seekp( 0 );
-      my->block_stream.write( (char*)&my->version, sizeof(my->version) );
-      my->block_stream.seekp( pos );
+      if (my->version_pending)
+         my->write_version();
       flush();
+
+      my->start_writer();
    }
 
    std::pair<signed_block_ptr, uint64_t> block_log::read_block(uint64_t pos)const {
-      my->check_open_files();
+      if( my->cfg.mmap_reads )
+         return my->read_mapped_block( pos );
 
-      my->block_stream.seekg(pos);
-      std::pair<signed_block_ptr,uint64_t> result;
-      result.first = std::make_shared<signed_block>();
-      fc::raw::unpack(my->block_stream, *result.first);
-      result.second = uint64_t(my->block_stream.tellg()) + 8;
-      return result;
+      return my->read_stream_block( pos );
    }
 
    signed_block_ptr block_log::read_block_by_num(uint32_t block_num)const {
       try {
-         signed_block_ptr b;
-         uint64_t pos = get_block_pos(block_num);
-         if (pos != npos) {
-            b = read_block(pos).first;
+         signed_block_ptr b = my->cache.get(block_num);
+         if( b )
+            return b;
+         if( my->cfg.async_append )
+            b = my->read_pending(block_num); // checked first, a block leaves the queue only after it became readable
+         if( b ) {
+            // queued, not written yet
+         } else if( my->cfg.mmap_reads ) {
+            b = my->read_mapped_block_by_num(block_num);
+         } else {
+            b = my->read_stream_block_by_num(block_num);
+         }
+         if (!b)
+            b = my->catalog.read_block_by_num(block_num);
+         if (b) {
             EOS_ASSERT(b->block_num() == block_num, reversible_blocks_exception,
                       "Wrong block was read from block log.", ("returned", b->block_num())("expected", block_num));
+            my->cache.put(b);
          }
          return b;
       } FC_LOG_AND_RETHROW()
    }
 
    uint64_t block_log::get_block_pos(uint32_t block_num) const {
-      my->check_open_files();
-      if (!(my->head && block_num <= block_header::num_from_id(my->head_id) && block_num >= my->first_block_num))
-         return npos;
-      my->index_stream.seekg(sizeof(uint64_t) * (block_num - my->first_block_num));
-      uint64_t pos;
-      my->index_stream.read((char*)&pos, sizeof(pos));
-      return pos;
+      if( my->cfg.mmap_reads )
+         return my->read_mapped_block_pos( block_num );
+
+      std::lock_guard<std::mutex> g( my->stream_mtx );
+      return my->read_stream_block_pos( block_num );
    }
 
    signed_block_ptr block_log::read_head()const {
+      my->wait_until_written(); // the writer thread owns the streams while it is busy
+      std::unique_lock<std::mutex> g( my->stream_mtx );
       my->check_open_files();
 
       uint64_t pos;
@@ -295,9 +1346,11 @@ namespace eosio { namespace chain {
       my->block_stream.seekg(-sizeof(pos), std::ios::end);
       my->block_stream.read((char*)&pos, sizeof(pos));
       if (pos != npos) {
-         return read_block(pos).first;
+         return my->unpack_stream_block(pos).first;
       } else {
-         return {};
+         g.unlock();
+         // blocks.log was just rotated, the head is the last block of the newest stride file
+         return my->catalog.read_block_by_num(my->catalog.last_block_num());
       }
    }
 
@@ -305,58 +1358,184 @@ namespace eosio { namespace chain {
       return my->head;
    }
 
+   uint32_t block_log::written_head_num() const {
+      return my->readable_head_num.load( std::memory_order_acquire );
+   }
+
    uint32_t block_log::first_block_num() const {
+      if (!my->catalog.empty())
+         return my->catalog.first_block_num();
+      std::lock_guard<std::mutex> g( my->mapped_mtx ); // the writer thread may be rotating blocks.log
       return my->first_block_num;
    }
 
+   block_log_cache_stats block_log::get_cache_stats() const {
+      return my->cache.get_stats();
+   }
+
    void block_log::construct_index() {
       ilog("Reconstructing Block Log Index...");
       my->close();
 
       fc::remove_all(my->index_file);
 
-      my->reopen();
+      construct_index(my->block_file, my->index_file, my->cfg.index_threads);
 
-      uint64_t end_pos;
+      my->reopen();
+   }
 
-      my->block_stream.seekg(-sizeof( uint64_t), std::ios::end);
-      my->block_stream.read((char*)&end_pos, sizeof(end_pos));
+   void block_log::construct_index(const fc::path& block_file_name, const fc::path& index_file_name,
+                                   uint16_t num_threads, const index_progress_callback& progress) {
+      const auto start = fc::time_point::now();
 
-      if( end_pos == npos ) {
-         ilog( "Block log contains no blocks. No need to construct index." );
-         return;
-      }
+      boost::iostreams::mapped_file_source log;
+      log.open( block_file_name.generic_string() );
+      fc::datastream<const char*> header( log.data(), log.size() );
 
-      signed_block tmp;
+      uint32_t version = 0;
+      fc::raw::unpack( header, version );
+      EOS_ASSERT( version >= min_supported_version && version <= max_supported_version, block_log_unsupported_version,
+                  "Unsupported version of block log. Block log version is ${version} while code supports version(s) [${min},${max}]",
+                  ("version", version)("min", block_log::min_supported_version)("max", block_log::max_supported_version) );
 
-      uint64_t pos = 0;
-      if (my->version == 1) {
-         pos = 4; // Skip version which should have already been checked.
-      } else {
-         pos = 8; // Skip version and first block offset which should have already been checked
+      uint32_t first_block_num = 1;
+      if (version != 1) {
+         fc::raw::unpack( header, first_block_num );
       }
-      my->block_stream.seekg(pos);
 
       genesis_state gs;
-      fc::raw::unpack(my->block_stream, gs);
+      fc::raw::unpack( header, gs );
 
       // skip the totem
-      if (my->version > 1) {
+      if (version > 1) {
          uint64_t totem;
-         my->block_stream.read((char*) &totem, sizeof(totem));
+         fc::raw::unpack( header, totem );
       }
+      const uint64_t first_entry_pos = header.tellp();
 
-      my->index_stream.seekp(0, std::ios::end);
-      while( pos < end_pos ) {
-         fc::raw::unpack(my->block_stream, tmp);
-         my->block_stream.read((char*)&pos, sizeof(pos));
-         if(tmp.block_num() % 1000 == 0)
-            ilog( "Block log index reconstructed for block ${n}", ("n", tmp.block_num()));
-         my->index_stream.write((char*)&pos, sizeof(pos));
+      std::fstream index_stream;
+      index_stream.exceptions(std::fstream::failbit | std::fstream::badbit);
+      index_stream.open(index_file_name.generic_string().c_str(), LOG_WRITE);
+      index_stream.close();
+
+      uint64_t end_pos;
+      EOS_ASSERT( log.size() >= sizeof(end_pos), block_log_exception,
+                  "Block log '${f}' is corrupt, it is too short to hold the position of its last block",
+                  ("f", block_file_name.generic_string()) );
+      memcpy( &end_pos, log.data() + log.size() - sizeof(end_pos), sizeof(end_pos) );
+      if( end_pos == npos ) {
+         ilog( "Block log contains no blocks. No need to construct index." );
+         return;
       }
+      EOS_ASSERT( end_pos >= first_entry_pos && end_pos < log.size(), block_log_exception,
+                  "Block log '${f}' is corrupt, position of its last block is out of range; repair it with --hard-replay-blockchain",
+                  ("f", block_file_name.generic_string()) );
+
+      fc::datastream<const char*> head_ds( log.data() + end_pos, log.size() - end_pos );
+      const uint32_t head_block_num = detail::unpack_entry_block_num( head_ds, version );
+      EOS_ASSERT( head_block_num >= first_block_num, block_log_exception,
+                  "Block log '${f}' is corrupt, last block ${n} precedes first block ${first}",
+                  ("f", block_file_name.generic_string())("n", head_block_num)("first", first_block_num) );
+      const uint32_t num_blocks = head_block_num - first_block_num + 1;
+
+      ilog( "Reconstructing index of '${f}' for blocks ${first} through ${last}",
+            ("f", block_file_name.generic_string())("first", first_block_num)("last", head_block_num) );
+
+      boost::iostreams::mapped_file_params index_params;
+      index_params.path = index_file_name.generic_string();
+      index_params.new_file_size = sizeof(uint64_t) * num_blocks;
+      boost::iostreams::mapped_file_sink index( index_params );
+      char* const index_data = index.data();
+      try {
+         // Walk the trailing positions from the end of the log back to the first block. Only 8 bytes per block are
+         // touched, so the walk costs little more than faulting in the log; the pages ahead of it are requested in
+         // large windows because the kernel does not read ahead for a backwards scan.
+         const uint64_t window = 64*1024*1024;
+         uint64_t prefetched_from = log.size();
+         uint64_t pos = end_pos;
+         for( uint32_t i = num_blocks; i > 0; --i ) {
+            memcpy( index_data + sizeof(uint64_t) * (i - 1), &pos, sizeof(pos) );
+            if( i == 1 )
+               break;
+
+            if( pos < prefetched_from + window / 2 && prefetched_from > 0 ) {
+               const uint64_t from = prefetched_from > window ? prefetched_from - window : 0;
+               const uint64_t page_from = from - from % detail::page_size();
+               posix_madvise( const_cast<char*>(log.data()) + page_from, prefetched_from - page_from, POSIX_MADV_WILLNEED );
+               prefetched_from = page_from;
+            }
+
+            uint64_t prev_pos;
+            EOS_ASSERT( pos >= first_entry_pos + sizeof(prev_pos), block_log_exception,
+                        "Block log '${f}' is corrupt, block ${n} starts at ${pos} which leaves no room for the blocks before it",
+                        ("f", block_file_name.generic_string())("n", first_block_num + i - 1)("pos", pos) );
+            memcpy( &prev_pos, log.data() + pos - sizeof(prev_pos), sizeof(prev_pos) );
+            EOS_ASSERT( prev_pos >= first_entry_pos && prev_pos < pos, block_log_exception,
+                        "Block log '${f}' is corrupt, the position stored before block ${n} is out of range",
+                        ("f", block_file_name.generic_string())("n", first_block_num + i - 1) );
+            pos = prev_pos;
+         }
+         EOS_ASSERT( pos == first_entry_pos, block_log_exception,
+                     "Block log '${f}' is corrupt, the chain of block positions does not lead back to the first block",
+                     ("f", block_file_name.generic_string()) );
+
+         // Verify in parallel that every indexed entry holds the expected block.
+         if( num_threads == 0 )
+            num_threads = static_cast<uint16_t>( std::max( 1u, std::thread::hardware_concurrency() ) );
+         const uint32_t blocks_per_task = std::max<uint32_t>( 10000, num_blocks / (num_threads * 8) + 1 );
+         std::atomic<uint32_t> verified{0};
+         std::vector<std::future<void>> tasks;
+         {
+            named_thread_pool pool( "blkidx", num_threads );
+            for( uint32_t task_first = 0; task_first < num_blocks; task_first += blocks_per_task ) {
+               const uint32_t task_end = std::min<uint64_t>( uint64_t(task_first) + blocks_per_task, num_blocks );
+               tasks.emplace_back( async_thread_pool( pool.get_executor(), [&, task_first, task_end]() {
+                  for( uint32_t i = task_first; i < task_end; ++i ) {
+                     uint64_t entry_pos;
+                     memcpy( &entry_pos, index_data + sizeof(uint64_t) * i, sizeof(entry_pos) );
+                     uint64_t entry_end = log.size();
+                     if( i + 1 < num_blocks )
+                        memcpy( &entry_end, index_data + sizeof(uint64_t) * (i + 1), sizeof(entry_end) );
+                     entry_end -= sizeof(uint64_t);
+                     fc::datastream<const char*> ds( log.data() + entry_pos, entry_end - entry_pos );
+                     const uint32_t n = detail::unpack_entry_block_num( ds, version );
+                     EOS_ASSERT( n == first_block_num + i, block_log_exception,
+                                 "Block log '${f}' is corrupt, expected block ${expected} at position ${pos} but found block ${n}",
+                                 ("f", block_file_name.generic_string())("expected", first_block_num + i)("pos", entry_pos)("n", n) );
+                     if( (i - task_first) % 1000 == 999 )
+                        verified += 1000;
+                  }
+                  verified += (task_end - task_first) % 1000;
+               } ) );
+            }
+
+            for( auto& t : tasks ) {
+               while( t.wait_for( std::chrono::seconds( 5 ) ) != std::future_status::ready ) {
+                  const uint32_t done = verified;
+                  ilog( "Block log index reconstruction ${p}% done (${n} of ${t} blocks verified)",
+                        ("p", uint64_t(done) * 100 / num_blocks)("n", done)("t", num_blocks) );
+                  if( progress )
+                     progress( done, num_blocks );
+               }
+            }
+            for( auto& t : tasks )
+               t.get(); // rethrows corruption found by a worker
+         }
+      } catch( ... ) {
+         // never leave an index behind that looks complete but was not verified
+         index.close();
+         fc::remove_all( index_file_name );
+         throw;
+      }
+
+      index.close();
+      if( progress )
+         progress( num_blocks, num_blocks );
+      ilog( "Block log index of ${n} blocks reconstructed in ${s} ms",
+            ("n", num_blocks)("s", (fc::time_point::now() - start).count() / 1000) );
    } // construct_index
 
-   fc::path block_log::repair_log( const fc::path& data_dir, uint32_t truncate_at_block ) {
+   fc::path block_log::repair_log( const fc::path& data_dir, uint32_t truncate_at_block, const fc::path& retained_dir ) {
       ilog("Recovering Block Log...");
       EOS_ASSERT( fc::is_directory(data_dir) && fc::is_regular_file(data_dir / "blocks.log"), block_log_not_found,
                  "Block log not found in '${blocks_dir}'", ("blocks_dir", data_dir)          );
@@ -376,12 +1555,45 @@ namespace eosio { namespace chain {
                  "Cannot move existing blocks directory to already existing directory '${new_blocks_dir}'",
                  ("new_blocks_dir", backup_dir) );
 
+      // a retained directory within the blocks directory moves to the backup with it and is moved back below
+      std::string retained_subdir;
+      if( !retained_dir.empty() && fc::is_directory( retained_dir ) ) {
+         const auto retained = fc::canonical( retained_dir ).generic_string();
+         const auto prefix = blocks_dir.generic_string() + "/";
+         if( retained.size() > prefix.size() && retained.compare( 0, prefix.size(), prefix ) == 0 )
+            retained_subdir = retained.substr( prefix.size() );
+      }
+
       fc::rename( blocks_dir, backup_dir );
       ilog( "Moved existing blocks directory to backup location: '${new_blocks_dir}'", ("new_blocks_dir", backup_dir) );
 
       fc::create_directories(blocks_dir);
+      if( !retained_subdir.empty() ) {
+         fc::create_directories( (blocks_dir / retained_subdir).parent_path() );
+         fc::rename( backup_dir / retained_subdir, blocks_dir / retained_subdir );
+         ilog( "Moved stride files in '${dir}' back from the backup", ("dir", blocks_dir / retained_subdir) );
+      }
       auto block_log_path = blocks_dir / "blocks.log";
 
+      // stride files never change once rotated out of blocks.log, so only blocks.log itself needs recovering; those
+      // in the blocks directory are retained there or still waiting to be copied to the retained directory
+      vector<fc::path> stride_files;
+      for( fc::directory_iterator itr( backup_dir ), end_itr; itr != end_itr; ++itr ) {
+         const fc::path p = *itr;
+         uint32_t first = 0, last = 0;
+         if( fc::is_regular_file( p ) && detail::parse_stride_file_name( p.filename().generic_string(), first, last ) ) {
+            stride_files.emplace_back( p );
+            const auto index = backup_dir / detail::stride_file_stem( first, last ).append( ".index" );
+            if( fc::exists( index ) )
+               stride_files.emplace_back( index );
+         }
+      }
+      for( const auto& p : stride_files ) {
+         fc::rename( p, blocks_dir / p.filename() );
+      }
+      if( !stride_files.empty() )
+         ilog( "Moved ${n} stride files back to '${blocks_dir}'", ("n", stride_files.size())("blocks_dir", blocks_dir) );
+
       ilog( "Reconstructing '${new_block_log}' from backed up block log", ("new_block_log", block_log_path) );
 
       std::fstream  old_block_stream;
@@ -437,9 +1649,8 @@ namespace eosio { namespace chain {
       uint64_t pos = old_block_stream.tellg();
       while( pos < end_pos ) {
          signed_block tmp;
-
          try {
-            fc::raw::unpack(old_block_stream, tmp);
+            detail::unpack_block_entry(old_block_stream, version, tmp);
          } catch( ... ) {
             except_ptr = std::current_exception();
             incomplete_block_data.resize( end_pos - pos );
@@ -460,8 +1671,9 @@ namespace eosio { namespace chain {
          }
          previous = id;
 
+         const uint64_t entry_end = old_block_stream.tellg();
          uint64_t tmp_pos = std::numeric_limits<uint64_t>::max();
-         if( (static_cast<uint64_t>(old_block_stream.tellg()) + sizeof(pos)) <= end_pos ) {
+         if( (entry_end + sizeof(pos)) <= end_pos ) {
             old_block_stream.read( reinterpret_cast<char*>(&tmp_pos), sizeof(tmp_pos) );
          }
          if( pos != tmp_pos ) {
@@ -469,7 +1681,11 @@ namespace eosio { namespace chain {
             break;
          }
 
-         auto data = fc::raw::pack(tmp);
+         // the entry is copied as it is, so that a compressed block is not compressed again
+         std::vector<char> data( entry_end - pos );
+         old_block_stream.seekg( pos );
+         old_block_stream.read( data.data(), data.size() );
+         old_block_stream.seekg( entry_end + sizeof(pos) );
          new_block_stream.write( data.data(), data.size() );
          new_block_stream.write( reinterpret_cast<char*>(&pos), sizeof(pos) );
          block_num = tmp.block_num();
@@ -523,24 +1739,7 @@ namespace eosio { namespace chain {
       EOS_ASSERT( fc::is_directory(data_dir) && fc::is_regular_file(data_dir / "blocks.log"), block_log_not_found,
                  "Block log not found in '${blocks_dir}'", ("blocks_dir", data_dir)          );
 
-      std::fstream  block_stream;
-      block_stream.open( (data_dir / "blocks.log").generic_string().c_str(), LOG_READ );
-
-      uint32_t version = 0;
-      block_stream.read( (char*)&version, sizeof(version) );
-      EOS_ASSERT( version > 0, block_log_exception, "Block log was not setup properly." );
-      EOS_ASSERT( version >= min_supported_version && version <= max_supported_version, block_log_unsupported_version,
-                 "Unsupported version of block log. Block log version is ${version} while code supports version(s) [${min},${max}]",
-                 ("version", version)("min", block_log::min_supported_version)("max", block_log::max_supported_version) );
-
-      uint32_t first_block_num = 1;
-      if (version != 1) {
-         block_stream.read ( (char*)&first_block_num, sizeof(first_block_num) );
-      }
-
-      genesis_state gs;
-      fc::raw::unpack(block_stream, gs);
-      return gs;
+      return detail::extract_genesis_state_from_file( data_dir / "blocks.log" );
    }
 
 } } /// eosio::chain
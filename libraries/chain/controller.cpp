@@ -15,6 +15,7 @@
 #include <eosio/chain/generated_transaction_object.hpp>
 #include <eosio/chain/transaction_object.hpp>
 #include <eosio/chain/reversible_block_object.hpp>
+#include <eosio/chain/reversible_block_log.hpp>
 #include <eosio/chain/genesis_intrinsics.hpp>
 #include <eosio/chain/whitelisted_intrinsics.hpp>
 
@@ -30,6 +31,8 @@
 #include <fc/scoped_exit.hpp>
 #include <fc/variant_object.hpp>
 
+#include <deque>
+
 namespace eosio { namespace chain {
 
 using resource_limits::resource_limits_manager;
@@ -209,7 +212,8 @@ struct pending_state {
 struct controller_impl {
    controller&                    self;
    chainbase::database            db;
-   chainbase::database            reversible_blocks; ///< a special database to persist blocks that have successfully been applied but are still reversible
+   optional<chainbase::database>  reversible_blocks; ///< a special database to persist blocks that have successfully been applied but are still reversible
+   optional<reversible_block_log> reversible_log; ///< replaces reversible_blocks when the ring file store is configured
    block_log                      blog;
    optional<pending_state>        pending;
    block_state_ptr                head;
@@ -239,6 +243,113 @@ struct controller_impl {
     */
    unapplied_transactions_type     unapplied_transactions;
 
+   void store_reversible_block( const signed_block_ptr& b ) {
+      if( reversible_log ) {
+         reversible_log->add( b );
+         return;
+      }
+      reversible_blocks->create<reversible_block_object>( [&]( auto& ubo ) {
+         ubo.blocknum = b->block_num();
+         ubo.set_block( b );
+      });
+   }
+
+   /// removes the newest reversible block, block_num
+   void remove_reversible_block( uint32_t block_num ) {
+      if( reversible_log ) {
+         reversible_log->remove_from( block_num );
+         return;
+      }
+      if( const auto* b = reversible_blocks->find<reversible_block_object,by_num>(block_num) )
+      {
+         reversible_blocks->remove( *b );
+      }
+   }
+
+   void remove_reversible_blocks_through( uint32_t block_num ) {
+      if( reversible_log ) {
+         reversible_log->remove_through( block_num );
+         return;
+      }
+      const auto& rbi = reversible_blocks->get_index<reversible_block_index,by_num>();
+      auto rbitr = rbi.begin();
+      while( rbitr != rbi.end() && rbitr->blocknum <= block_num ) {
+         reversible_blocks->remove( *rbitr );
+         rbitr = rbi.begin();
+      }
+   }
+
+   signed_block_ptr read_reversible_block( uint32_t block_num )const {
+      if( reversible_log )
+         return reversible_log->read_block( block_num );
+      if( const auto* obj = reversible_blocks->find<reversible_block_object,by_num>(block_num) )
+         return obj->get_block();
+      return signed_block_ptr();
+   }
+
+   optional<block_id_type> read_reversible_block_id( uint32_t block_num )const {
+      if( reversible_log )
+         return reversible_log->read_block_id( block_num );
+      if( const auto* obj = reversible_blocks->find<reversible_block_object,by_num>(block_num) )
+         return obj->get_block_id();
+      return optional<block_id_type>();
+   }
+
+   /// first and last stored reversible block numbers, 0 if there are none
+   std::pair<uint32_t, uint32_t> reversible_block_range()const {
+      if( reversible_log )
+         return { reversible_log->first_block_num(), reversible_log->last_block_num() };
+      const auto& rbi = reversible_blocks->get_index<reversible_block_index,by_num>();
+      if( rbi.empty() )
+         return { 0, 0 };
+      return { rbi.begin()->blocknum, rbi.rbegin()->blocknum };
+   }
+
+   /**
+    *  Appends to the block log the irreversible blocks that an asynchronous append queued but did not write before the
+    *  node stopped. They were kept in the reversible store for this reason.
+    */
+   void recover_unwritten_irreversible_blocks( uint32_t lib_num ) {
+      const uint32_t first = blog.head() ? blog.head()->block_num() + 1 : blog.first_block_num();
+      if( first > lib_num || !read_reversible_block( first ) )
+         return;
+
+      wlog( "block log ends before the last irreversible block ${lib}, appending blocks ${first} through ${lib} from the reversible blocks",
+            ("lib", lib_num)("first", first) );
+      for( uint32_t n = first; n <= lib_num; ++n ) {
+         auto b = read_reversible_block( n );
+         EOS_ASSERT( b, block_log_exception, "irreversible block ${n} is neither in the block log nor among the reversible blocks",
+                     ("n", n) );
+         blog.append( b );
+      }
+      blog.flush();
+   }
+
+   /**
+    * copies the blocks of an existing reversible blocks database into a new ring file and renames the database file
+    * so that it is kept but not used again; on failure the new ring file is removed so that the import is retried
+    */
+   void import_reversible_database( const fc::path& db_dir, const fc::path& ring_file ) {
+      try {
+         {
+            chainbase::database old_db( db_dir, database::read_only, conf.reversible_cache_size );
+            old_db.add_index<reversible_block_index>();
+            const auto& rbi = old_db.get_index<reversible_block_index,by_num>();
+            for( auto itr = rbi.begin(); itr != rbi.end(); ++itr )
+               reversible_log->add( itr->get_block() );
+            ilog( "Imported ${n} blocks from the reversible blocks database into the reversible block log", ("n", rbi.size()) );
+         }
+         const auto db_file = db_dir / "shared_memory.bin";
+         fc::rename( db_file, db_dir / "shared_memory.bin.imported" );
+         ilog( "Renamed the imported reversible blocks database ${f} to shared_memory.bin.imported", ("f", db_file.generic_string()) );
+      } catch( ... ) {
+         elog( "Unable to import the reversible blocks database ${d}", ("d", db_dir.generic_string()) );
+         reversible_log.reset();
+         fc::remove_all( ring_file );
+         throw;
+      }
+   }
+
    void pop_block() {
       auto prev = fork_db.get_block( head->header.previous );
 
@@ -247,10 +358,7 @@ struct controller_impl {
          prev = fork_db.root();
       }
 
-      if( const auto* b = reversible_blocks.find<reversible_block_object,by_num>(head->block_num) )
-      {
-         reversible_blocks.remove( *b );
-      }
+      remove_reversible_block( head->block_num );
 
       if ( read_mode == db_read_mode::SPECULATIVE ) {
          EOS_ASSERT( head->block, block_validate_exception, "attempting to pop a block that was sparsely loaded from a snapshot");
@@ -288,12 +396,9 @@ struct controller_impl {
     db( cfg.state_dir,
         cfg.read_only ? database::read_only : database::read_write,
         cfg.state_size, false, cfg.db_map_mode, cfg.db_hugepage_paths ),
-    reversible_blocks( cfg.blocks_dir/config::reversible_blocks_dir_name,
-        cfg.read_only ? database::read_only : database::read_write,
-        cfg.reversible_cache_size, false, cfg.db_map_mode, cfg.db_hugepage_paths ),
-    blog( cfg.blocks_dir ),
+    blog( cfg.blocks_dir, cfg.blog_config ),
     fork_db( cfg.state_dir ),
-    wasmif( cfg.wasm_runtime, db ),
+    wasmif( cfg.wasm_runtime, db, cfg.wasm_config ),
     resource_limits( db ),
     authorization( s, db ),
     protocol_features( std::move(pfs) ),
@@ -302,6 +407,18 @@ struct controller_impl {
     read_mode( cfg.read_mode ),
     thread_pool( "chain", cfg.thread_pool_size )
    {
+      const auto reversible_dir = cfg.blocks_dir/config::reversible_blocks_dir_name;
+      if( cfg.reversible_store == reversible_blocks_store::ring_file ) {
+         const auto ring_file = reversible_dir / config::reversible_blocks_ring_file_name;
+         const bool import_db = !fc::exists( ring_file ) && fc::exists( reversible_dir / "shared_memory.bin" );
+         reversible_log.emplace( ring_file, cfg.reversible_cache_size, cfg.read_only );
+         if( import_db && !cfg.read_only )
+            import_reversible_database( reversible_dir, ring_file );
+      } else {
+         reversible_blocks.emplace( reversible_dir,
+                                    cfg.read_only ? database::read_only : database::read_write,
+                                    cfg.reversible_cache_size, false, cfg.db_map_mode, cfg.db_hugepage_paths );
+      }
 
       fork_db.open( [this]( block_timestamp_type timestamp,
                             const flat_set<digest_type>& cur_features,
@@ -386,8 +503,6 @@ struct controller_impl {
 
       const auto branch = fork_db.fetch_branch( fork_head->id, fork_head->dpos_irreversible_blocknum );
       try {
-         const auto& rbi = reversible_blocks.get_index<reversible_block_index,by_num>();
-
          for( auto bitr = branch.rbegin(); bitr != branch.rend(); ++bitr ) {
             if( read_mode == db_read_mode::IRREVERSIBLE ) {
                apply_block( *bitr, controller::block_status::complete );
@@ -402,11 +517,11 @@ struct controller_impl {
 
             blog.append( (*bitr)->block );
 
-            auto rbitr = rbi.begin();
-            while( rbitr != rbi.end() && rbitr->blocknum <= (*bitr)->block_num ) {
-               reversible_blocks.remove( *rbitr );
-               rbitr = rbi.begin();
-            }
+            // a block only queued by an asynchronous append is kept in the reversible store until it is written, so
+            // that a crash or a failed writer does not lose it; in irreversible mode it is not stored there yet
+            if( blog.written_head_num() < (*bitr)->block_num && read_mode == db_read_mode::IRREVERSIBLE )
+               store_reversible_block( (*bitr)->block );
+            remove_reversible_blocks_through( blog.written_head_num() );
          }
       } catch( fc::exception& ) {
          if( root_id != fork_db.root()->id ) {
@@ -446,6 +561,29 @@ struct controller_impl {
       initialize_database();
    }
 
+   struct prefetched_block {
+      signed_block_ptr                      block;
+      std::vector<transaction_metadata_ptr> packed_trxs; ///< empty when the block has to prepare them itself
+   };
+
+   /// unpacks the packed transactions of b and recovers their keys if replay checks them, safe on any thread
+   prefetched_block prefetch_block( const signed_block_ptr& b )const {
+      prefetched_block result{ b };
+      if( !b )
+         return result;
+      result.packed_trxs.reserve( b->transactions.size() );
+      for( const auto& receipt : b->transactions ) {
+         if( receipt.trx.contains<packed_transaction>() ) {
+            auto mtrx = std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>( receipt.trx.get<packed_transaction>() ) );
+            // irreversible blocks only skip the auth check without force_all_checks, see controller::skip_auth_check
+            if( conf.force_all_checks )
+               mtrx->recover_keys( chain_id );
+            result.packed_trxs.emplace_back( std::move( mtrx ) );
+         }
+      }
+      return result;
+   }
+
    void replay(std::function<bool()> shutdown) {
       auto blog_head = blog.head();
       auto blog_head_time = blog_head->timestamp.to_time_point();
@@ -459,10 +597,36 @@ struct controller_impl {
          ilog( "existing block log, attempting to replay from ${s} to ${n} blocks",
                ("s", start_block_num)("n", blog_head->block_num()) );
          try {
-            while( auto next = blog.read_block_by_num( head->block_num + 1 ) ) {
-               replay_push_block( next, controller::block_status::irreversible );
-               if( next->block_num() % 500 == 0 ) {
-                  ilog( "${n} of ${head}", ("n", next->block_num())("head", blog_head->block_num()) );
+            // blocks are read, unpacked and have their keys recovered on the thread pool ahead of the apply loop
+            std::deque<std::future<prefetched_block>> prefetched;
+            auto wait_prefetched = fc::make_scoped_exit( [&prefetched]() {
+               for( auto& f : prefetched )
+                  f.wait();
+            } );
+            uint32_t next_prefetch = start_block_num;
+
+            while( true ) {
+               prefetched_block next;
+               if( conf.replay_prefetch_blocks > 0 ) {
+                  while( prefetched.size() < conf.replay_prefetch_blocks && next_prefetch <= blog_head->block_num() ) {
+                     prefetched.emplace_back( async_thread_pool( thread_pool.get_executor(),
+                        [this, block_num = next_prefetch++]() {
+                           return prefetch_block( blog.read_block_by_num( block_num ) );
+                        } ) );
+                  }
+                  if( prefetched.empty() )
+                     break;
+                  next = prefetched.front().get();
+                  prefetched.pop_front();
+               } else {
+                  next.block = blog.read_block_by_num( head->block_num + 1 );
+               }
+               if( !next.block )
+                  break;
+
+               replay_push_block( next.block, controller::block_status::irreversible, std::move( next.packed_trxs ) );
+               if( next.block->block_num() % 500 == 0 ) {
+                  ilog( "${n} of ${head}", ("n", next.block->block_num())("head", blog_head->block_num()) );
                   if( shutdown() ) break;
                }
             }
@@ -495,9 +659,9 @@ struct controller_impl {
 
       if( !except_ptr && !shutdown() ) {
          int rev = 0;
-         while( auto obj = reversible_blocks.find<reversible_block_object,by_num>(head->block_num+1) ) {
+         while( auto b = read_reversible_block( head->block_num+1 ) ) {
             ++rev;
-            replay_push_block( obj->get_block(), controller::block_status::validated );
+            replay_push_block( b, controller::block_status::validated );
          }
          ilog( "${n} reversible blocks replayed", ("n",rev) );
       }
@@ -554,6 +718,7 @@ struct controller_impl {
             }
          } else {
             lib_num = fork_db.root()->block_num;
+            recover_unwritten_irreversible_blocks( lib_num );
             auto first_block_num = blog.first_block_num();
             if( blog.head() ) {
                EOS_ASSERT( first_block_num <= lib_num && lib_num <= blog.head()->block_num(),
@@ -596,31 +761,26 @@ struct controller_impl {
 
       protocol_features.init( db );
 
-      const auto& rbi = reversible_blocks.get_index<reversible_block_index,by_num>();
       auto last_block_num = lib_num;
 
       if( read_mode == db_read_mode::IRREVERSIBLE ) {
          // ensure there are no reversible blocks
-         auto itr = rbi.begin();
-         if( itr != rbi.end() ) {
+         const auto range = reversible_block_range();
+         if( range.second ) {
             wlog( "read_mode has changed to irreversible: erasing reversible blocks" );
+            remove_reversible_blocks_through( range.second );
          }
-         for( ; itr != rbi.end(); itr = rbi.begin() )
-            reversible_blocks.remove( *itr );
       } else {
-         auto itr = rbi.begin();
-         for( ; itr != rbi.end() && itr->blocknum <= lib_num; itr = rbi.begin() )
-            reversible_blocks.remove( *itr );
+         remove_reversible_blocks_through( lib_num );
+         const auto range = reversible_block_range();
 
-         EOS_ASSERT( itr == rbi.end() || itr->blocknum == lib_num + 1, reversible_blocks_exception,
+         EOS_ASSERT( range.first == 0 || range.first == lib_num + 1, reversible_blocks_exception,
                      "gap exists between last irreversible block and first reversible block",
-                     ("lib", lib_num)("first_reversible_block_num", itr->blocknum)
+                     ("lib", lib_num)("first_reversible_block_num", range.first)
          );
 
-         auto ritr = rbi.rbegin();
-
-         if( ritr != rbi.rend() ) {
-            last_block_num = ritr->blocknum;
+         if( range.second ) {
+            last_block_num = range.second;
          }
 
          EOS_ASSERT( head->block_num <= last_block_num, reversible_blocks_exception,
@@ -630,28 +790,28 @@ struct controller_impl {
 
          auto pending_head = fork_db.pending_head();
 
-         if( ritr != rbi.rend()
+         if( range.second
              && lib_num < pending_head->block_num
              && pending_head->block_num <= last_block_num
          ) {
-            auto rbitr = rbi.find( pending_head->block_num );
-            EOS_ASSERT( rbitr != rbi.end(), reversible_blocks_exception, "pending head block not found in reversible blocks");
-            auto rev_id = rbitr->get_block_id();
-            EOS_ASSERT( rev_id == pending_head->id,
+            auto rev_id = read_reversible_block_id( pending_head->block_num );
+            EOS_ASSERT( rev_id, reversible_blocks_exception, "pending head block not found in reversible blocks");
+            EOS_ASSERT( *rev_id == pending_head->id,
                         reversible_blocks_exception,
                         "mismatch in block id of pending head block ${num} in reversible blocks database: "
                         "expected: ${expected}, actual: ${actual}",
-                        ("num", pending_head->block_num)("expected", pending_head->id)("actual", rev_id)
+                        ("num", pending_head->block_num)("expected", pending_head->id)("actual", *rev_id)
             );
-         } else if( ritr != rbi.rend() && last_block_num < pending_head->block_num ) {
+         } else if( range.second && last_block_num < pending_head->block_num ) {
             const auto b = fork_db.search_on_branch( pending_head->id, last_block_num );
             FC_ASSERT( b, "unexpected violation of invariants" );
-            auto rev_id = ritr->get_block_id();
-            EOS_ASSERT( rev_id == b->id,
+            auto rev_id = read_reversible_block_id( last_block_num );
+            FC_ASSERT( rev_id, "unexpected violation of invariants" );
+            EOS_ASSERT( *rev_id == b->id,
                         reversible_blocks_exception,
                         "mismatch in block id of last block (${num}) in reversible blocks database: "
                         "expected: ${expected}, actual: ${actual}",
-                        ("num", last_block_num)("expected", b->id)("actual", rev_id)
+                        ("num", last_block_num)("expected", b->id)("actual", *rev_id)
             );
          }
          // else no checks needed since fork_db will be completely reset on replay anyway
@@ -692,7 +852,8 @@ struct controller_impl {
    }
 
    void add_indices() {
-      reversible_blocks.add_index<reversible_block_index>();
+      if( reversible_blocks )
+         reversible_blocks->add_index<reversible_block_index>();
 
       controller_index_set::add_indices(db);
       contract_database_index_set::add_indices(db);
@@ -1593,10 +1754,7 @@ struct controller_impl {
          }
 
          if( !replay_head_time && read_mode != db_read_mode::IRREVERSIBLE ) {
-            reversible_blocks.create<reversible_block_object>( [&]( auto& ubo ) {
-               ubo.blocknum = bsp->block_num;
-               ubo.set_block( bsp->block );
-            });
+            store_reversible_block( bsp->block );
          }
 
          if( add_to_fork_db ) {
@@ -1676,7 +1834,8 @@ struct controller_impl {
       }
    }
 
-   void apply_block( const block_state_ptr& bsp, controller::block_status s )
+   void apply_block( const block_state_ptr& bsp, controller::block_status s,
+                     std::vector<transaction_metadata_ptr> prefetched_trxs = {} )
    { try {
       try {
          const signed_block_ptr& b = bsp->block;
@@ -1686,19 +1845,22 @@ struct controller_impl {
          auto producer_block_id = b->id();
          start_block( b->timestamp, b->confirmed, new_protocol_feature_activations, s, producer_block_id);
 
-         std::vector<transaction_metadata_ptr> packed_transactions;
-         packed_transactions.reserve( b->transactions.size() );
-         for( const auto& receipt : b->transactions ) {
-            if( receipt.trx.contains<packed_transaction>()) {
-               auto& pt = receipt.trx.get<packed_transaction>();
-               auto mtrx = std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>( pt ) );
-               if( !self.skip_auth_check() ) {
-                  transaction_metadata::start_recover_keys( mtrx, thread_pool.get_executor(), chain_id, microseconds::maximum() );
+         std::vector<transaction_metadata_ptr> packed_transactions = std::move( prefetched_trxs );
+         if( packed_transactions.empty() ) {
+            packed_transactions.reserve( b->transactions.size() );
+            for( const auto& receipt : b->transactions ) {
+               if( receipt.trx.contains<packed_transaction>()) {
+                  auto& pt = receipt.trx.get<packed_transaction>();
+                  packed_transactions.emplace_back( std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>( pt ) ) );
                }
-               packed_transactions.emplace_back( std::move( mtrx ) );
             }
          }
-
+         if( !self.skip_auth_check() ) {
+            for( const auto& mtrx : packed_transactions ) {
+               // returns right away for transactions whose keys were recovered while prefetching
+               transaction_metadata::start_recover_keys( mtrx, thread_pool.get_executor(), chain_id, microseconds::maximum() );
+            }
+         }
          transaction_trace_ptr trace;
 
          size_t packed_idx = 0;
@@ -1764,6 +1926,34 @@ struct controller_impl {
       }
    } FC_CAPTURE_AND_RETHROW() } /// apply_block
 
+   /// the code of the contracts the actions and context free actions of trxs are sent to that is not instantiated
+   /// yet and can be compiled on the compile threads
+   vector<const account_metadata_object*> uncompiled_receivers( const std::vector<transaction_metadata_ptr>& trxs ) {
+      flat_set<account_name> receivers;
+      vector<const account_metadata_object*> uncompiled;
+      auto collect = [&]( const vector<action>& actions ) {
+         for( const auto& act : actions ) {
+            if( !receivers.insert( act.account ).second )
+               continue;
+            const auto* receiver = db.find<account_metadata_object, by_name>( act.account );
+            if( receiver && receiver->code_hash != digest_type()
+                && wasmif.needs_precompile( receiver->code_hash, receiver->vm_type, receiver->vm_version ) )
+               uncompiled.push_back( receiver );
+         }
+      };
+      for( const auto& mtrx : trxs ) {
+         const auto& trx = mtrx->packed_trx->get_transaction();
+         collect( trx.context_free_actions );
+         collect( trx.actions );
+      }
+      return uncompiled;
+   }
+
+   void precompile_contracts( const vector<const account_metadata_object*>& receivers ) {
+      for( const auto* receiver : receivers )
+         wasmif.precompile( receiver->code_hash, receiver->vm_type, receiver->vm_version );
+   }
+
    std::future<block_state_ptr> create_block_state_future( const signed_block_ptr& b ) {
       EOS_ASSERT( b, block_validate_exception, "null block" );
 
@@ -1821,7 +2011,8 @@ struct controller_impl {
       } FC_LOG_AND_RETHROW( )
    }
 
-   void replay_push_block( const signed_block_ptr& b, controller::block_status s ) {
+   void replay_push_block( const signed_block_ptr& b, controller::block_status s,
+                           std::vector<transaction_metadata_ptr> packed_trxs = {} ) {
       self.validate_db_available_size();
       self.validate_reversible_available_size();
 
@@ -1851,7 +2042,7 @@ struct controller_impl {
          emit( self.accepted_block_header, bsp );
 
          if( s == controller::block_status::irreversible ) {
-            apply_block( bsp, s );
+            apply_block( bsp, s, std::move( packed_trxs ) );
             head = bsp;
 
             // On replay, log_irreversible is not called and so no irreversible_block signal is emittted.
@@ -2478,6 +2669,10 @@ void controller::push_block( std::future<block_state_ptr>& block_state_future )
    my->push_block( block_state_future );
 }
 
+void controller::precompile_contracts( const transaction_metadata_ptr& trx ) {
+   my->precompile_contracts( my->uncompiled_receivers( {trx} ) );
+}
+
 transaction_trace_ptr controller::push_transaction( const transaction_metadata_ptr& trx, fc::time_point deadline, uint32_t billed_cpu_time_us ) {
    validate_db_available_size();
    EOS_ASSERT( get_read_mode() != chain::db_read_mode::READ_ONLY, transaction_type_exception, "push transaction not allowed in read-only mode" );
@@ -2670,10 +2865,9 @@ block_state_ptr controller::fetch_block_state_by_id( block_id_type id )const {
 }
 
 block_state_ptr controller::fetch_block_state_by_number( uint32_t block_num )const  { try {
-   const auto& rev_blocks = my->reversible_blocks.get_index<reversible_block_index,by_num>();
-   auto objitr = rev_blocks.find(block_num);
+   const auto rev_id = my->read_reversible_block_id( block_num );
 
-   if( objitr == rev_blocks.end() ) {
+   if( !rev_id ) {
       if( my->read_mode == db_read_mode::IRREVERSIBLE ) {
          return my->fork_db.search_on_branch( my->fork_db.pending_head()->id, block_num );
       } else {
@@ -2681,7 +2875,7 @@ block_state_ptr controller::fetch_block_state_by_number( uint32_t block_num )con
       }
    }
 
-   return my->fork_db.get_block( objitr->get_block_id() );
+   return my->fork_db.get_block( *rev_id );
 } FC_CAPTURE_AND_RETHROW( (block_num) ) }
 
 block_id_type controller::get_block_id_for_num( uint32_t block_num )const { try {
@@ -2691,10 +2885,8 @@ block_id_type controller::get_block_id_for_num( uint32_t block_num )const { try
 
    if( !find_in_blog ) {
       if( my->read_mode != db_read_mode::IRREVERSIBLE ) {
-         const auto& rev_blocks = my->reversible_blocks.get_index<reversible_block_index,by_num>();
-         auto objitr = rev_blocks.find(block_num);
-         if( objitr != rev_blocks.end() ) {
-            return objitr->get_block_id();
+         if( const auto rev_id = my->read_reversible_block_id( block_num ) ) {
+            return *rev_id;
          }
       } else {
          auto bsp = my->fork_db.search_on_branch( my->fork_db.pending_head()->id, block_num );
@@ -2711,6 +2903,10 @@ block_id_type controller::get_block_id_for_num( uint32_t block_num )const { try
    return signed_blk->id();
 } FC_CAPTURE_AND_RETHROW( (block_num) ) }
 
+block_log_cache_stats controller::get_block_cache_stats()const {
+   return my->blog.get_cache_stats();
+}
+
 sha256 controller::calculate_integrity_hash()const { try {
    return my->calculate_integrity_hash();
 } FC_LOG_AND_RETHROW() }
@@ -2885,6 +3081,10 @@ wasm_interface& controller::get_wasm_interface() {
    return my->wasmif;
 }
 
+const wasm_interface& controller::get_wasm_interface()const {
+   return my->wasmif;
+}
+
 const account_object& controller::get_account( account_name name )const
 { try {
    return my->db.get<account_object, by_name>(name);
@@ -2964,7 +3164,8 @@ void controller::validate_db_available_size() const {
 }
 
 void controller::validate_reversible_available_size() const {
-   const auto free = my->reversible_blocks.get_segment_manager()->get_free_memory();
+   const auto free = my->reversible_log ? my->reversible_log->free_space()
+                                        : my->reversible_blocks->get_segment_manager()->get_free_memory();
    const auto guard = my->conf.reversible_guard_size;
    EOS_ASSERT(free >= guard, reversible_guard_exception, "reversible free: ${f}, guard size: ${g}", ("f", free)("g",guard));
 }
@@ -184,6 +184,7 @@ void apply_eosio_setcode(apply_context& context) {
             o.vm_version = act.vmversion;
          });
       }
+      context.control.get_wasm_interface().precompile(code_hash, act.vmtype, act.vmversion);
    }
 
    db.modify( account, [&]( auto& a ) {
@@ -23,47 +23,48 @@ class apply_context {
       template<typename T>
       class iterator_cache {
          public:
-            iterator_cache(){
-               _end_iterator_to_table.reserve(8);
-               _iterator_to_object.reserve(32);
-            }
+            iterator_cache() : _storage( acquire_storage() ) {}
+            ~iterator_cache() { release_storage( std::move(_storage) ); }
+
+            iterator_cache( const iterator_cache& ) = delete;
+            iterator_cache& operator=( const iterator_cache& ) = delete;
 
             /// Returns end iterator of the table.
             int cache_table( const table_id_object& tobj ) {
-               auto itr = _table_cache.find(tobj.id);
-               if( itr != _table_cache.end() )
+               auto itr = _storage->table_cache.find(tobj.id);
+               if( itr != _storage->table_cache.end() )
                   return itr->second.second;
 
-               auto ei = index_to_end_iterator(_end_iterator_to_table.size());
-               _end_iterator_to_table.push_back( &tobj );
-               _table_cache.emplace( tobj.id, make_pair(&tobj, ei) );
+               auto ei = index_to_end_iterator(_storage->end_iterator_to_table.size());
+               _storage->end_iterator_to_table.push_back( &tobj );
+               _storage->table_cache.emplace( tobj.id, make_pair(&tobj, ei) );
                return ei;
             }
 
             const table_id_object& get_table( table_id_object::id_type i )const {
-               auto itr = _table_cache.find(i);
-               EOS_ASSERT( itr != _table_cache.end(), table_not_in_cache, "an invariant was broken, table should be in cache" );
+               auto itr = _storage->table_cache.find(i);
+               EOS_ASSERT( itr != _storage->table_cache.end(), table_not_in_cache, "an invariant was broken, table should be in cache" );
                return *itr->second.first;
             }
 
             int get_end_iterator_by_table_id( table_id_object::id_type i )const {
-               auto itr = _table_cache.find(i);
-               EOS_ASSERT( itr != _table_cache.end(), table_not_in_cache, "an invariant was broken, table should be in cache" );
+               auto itr = _storage->table_cache.find(i);
+               EOS_ASSERT( itr != _storage->table_cache.end(), table_not_in_cache, "an invariant was broken, table should be in cache" );
                return itr->second.second;
             }
 
             const table_id_object* find_table_by_end_iterator( int ei )const {
                EOS_ASSERT( ei < -1, invalid_table_iterator, "not an end iterator" );
                auto indx = end_iterator_to_index(ei);
-               if( indx >= _end_iterator_to_table.size() ) return nullptr;
-               return _end_iterator_to_table[indx];
+               if( indx >= _storage->end_iterator_to_table.size() ) return nullptr;
+               return _storage->end_iterator_to_table[indx];
             }
 
             const T& get( int iterator ) {
                EOS_ASSERT( iterator != -1, invalid_table_iterator, "invalid iterator" );
                EOS_ASSERT( iterator >= 0, table_operation_not_permitted, "dereference of end iterator" );
-               EOS_ASSERT( (size_t)iterator < _iterator_to_object.size(), invalid_table_iterator, "iterator out of range" );
-               auto result = _iterator_to_object[iterator];
+               EOS_ASSERT( (size_t)iterator < _storage->iterator_to_object.size(), invalid_table_iterator, "iterator out of range" );
+               auto result = _storage->iterator_to_object[iterator];
                EOS_ASSERT( result, table_operation_not_permitted, "dereference of deleted object" );
                return *result;
             }
@@ -71,30 +72,134 @@ class apply_context {
             void remove( int iterator ) {
                EOS_ASSERT( iterator != -1, invalid_table_iterator, "invalid iterator" );
                EOS_ASSERT( iterator >= 0, table_operation_not_permitted, "cannot call remove on end iterators" );
-               EOS_ASSERT( (size_t)iterator < _iterator_to_object.size(), invalid_table_iterator, "iterator out of range" );
+               EOS_ASSERT( (size_t)iterator < _storage->iterator_to_object.size(), invalid_table_iterator, "iterator out of range" );
 
-               auto obj_ptr = _iterator_to_object[iterator];
+               auto obj_ptr = _storage->iterator_to_object[iterator];
                if( !obj_ptr ) return;
-               _iterator_to_object[iterator] = nullptr;
-               _object_to_iterator.erase( obj_ptr );
+               _storage->iterator_to_object[iterator] = nullptr;
+               _storage->object_to_iterator.erase( obj_ptr );
             }
 
             int add( const T& obj ) {
-               auto itr = _object_to_iterator.find( &obj );
-               if( itr != _object_to_iterator.end() )
-                    return itr->second;
+               auto existing = _storage->object_to_iterator.find( &obj );
+               if( existing >= 0 )
+                    return existing;
 
-               _iterator_to_object.push_back( &obj );
-               _object_to_iterator[&obj] = _iterator_to_object.size() - 1;
+               _storage->iterator_to_object.push_back( &obj );
+               _storage->object_to_iterator.insert( &obj, _storage->iterator_to_object.size() - 1 );
 
-               return _iterator_to_object.size() - 1;
+               return _storage->iterator_to_object.size() - 1;
             }
 
          private:
-            map<table_id_object::id_type, pair<const table_id_object*, int>> _table_cache;
-            vector<const table_id_object*>                  _end_iterator_to_table;
-            vector<const T*>                                _iterator_to_object;
-            map<const T*,int>                               _object_to_iterator;
+            /// Maps objects to their iterators in one array, probing linearly from the slot the address hashes to.
+            /// The array is kept at most half full.
+            class object_index {
+               public:
+                  /// Returns -1 if obj is not in the index.
+                  int find( const T* obj )const {
+                     if( _slots.empty() ) return -1;
+                     for( size_t i = slot_of(obj); ; i = (i + 1) & mask() ) {
+                        if( _slots[i].first == obj ) return _slots[i].second;
+                        if( !_slots[i].first ) return -1;
+                     }
+                  }
+
+                  /// Precondition: obj is not in the index
+                  void insert( const T* obj, int iterator ) {
+                     if( (_size + 1) * 2 > _slots.size() )
+                        rehash( std::max<size_t>( _slots.size() * 2, 64 ) );
+                     size_t i = slot_of(obj);
+                     while( _slots[i].first )
+                        i = (i + 1) & mask();
+                     _slots[i] = { obj, iterator };
+                     ++_size;
+                  }
+
+                  void erase( const T* obj ) {
+                     if( _slots.empty() ) return;
+                     size_t i = slot_of(obj);
+                     while( _slots[i].first != obj ) {
+                        if( !_slots[i].first ) return;
+                        i = (i + 1) & mask();
+                     }
+                     // move later entries of the probe sequence back, so that no lookup stops at the freed slot early
+                     for( size_t j = (i + 1) & mask(); _slots[j].first; j = (j + 1) & mask() ) {
+                        const size_t home = slot_of(_slots[j].first);
+                        if( ((j - home) & mask()) >= ((j - i) & mask()) ) {
+                           _slots[i] = _slots[j];
+                           i = j;
+                        }
+                     }
+                     _slots[i] = { nullptr, 0 };
+                     --_size;
+                  }
+
+                  void clear() {
+                     std::fill( _slots.begin(), _slots.end(), std::make_pair( (const T*)nullptr, 0 ) );
+                     _size = 0;
+                  }
+
+                  size_t capacity()const { return _slots.size(); }
+
+               private:
+                  size_t mask()const { return _slots.size() - 1; }
+                  size_t slot_of( const T* obj )const {
+                     return ((uint64_t)reinterpret_cast<uintptr_t>(obj) * 0x9E3779B97F4A7C15ull >> 32) & mask();
+                  }
+
+                  void rehash( size_t capacity ) {
+                     vector<pair<const T*, int>> old( capacity, std::make_pair( (const T*)nullptr, 0 ) );
+                     std::swap( old, _slots );
+                     _size = 0;
+                     for( const auto& slot : old )
+                        if( slot.first ) insert( slot.first, slot.second );
+                  }
+
+                  vector<pair<const T*, int>>  _slots;
+                  size_t                       _size = 0;
+            };
+
+            struct storage {
+               flat_map<table_id_object::id_type, pair<const table_id_object*, int>> table_cache;
+               vector<const table_id_object*>                  end_iterator_to_table;
+               vector<const T*>                                iterator_to_object;
+               object_index                                    object_to_iterator;
+            };
+
+            /// Each action has its own caches, so storage is reused from the caches of earlier actions on the thread
+            /// instead of being allocated again.
+            static vector<std::unique_ptr<storage>>& storage_pool() {
+               static thread_local vector<std::unique_ptr<storage>> pool;
+               return pool;
+            }
+
+            static std::unique_ptr<storage> acquire_storage() {
+               auto& pool = storage_pool();
+               if( pool.empty() ) {
+                  auto s = std::make_unique<storage>();
+                  s->end_iterator_to_table.reserve(8);
+                  s->iterator_to_object.reserve(32);
+                  return s;
+               }
+               auto s = std::move( pool.back() );
+               pool.pop_back();
+               return s;
+            }
+
+            static void release_storage( std::unique_ptr<storage> s ) {
+               // storage grown by an unusually large action is freed rather than kept around
+               constexpr size_t max_pooled_iterators = 4096;
+               if( !s || s->iterator_to_object.capacity() > max_pooled_iterators || s->object_to_iterator.capacity() > 2 * max_pooled_iterators )
+                  return;
+               s->table_cache.clear();
+               s->end_iterator_to_table.clear();
+               s->iterator_to_object.clear();
+               s->object_to_iterator.clear();
+               storage_pool().push_back( std::move(s) );
+            }
+
+            std::unique_ptr<storage> _storage;
 
             /// Precondition: std::numeric_limits<int>::min() < ei < -1
             /// Iterator of -1 is reserved for invalid iterators (i.e. when the appropriate table has not yet been created).
@@ -6,11 +6,79 @@
 #include <fc/filesystem.hpp>
 #include <eosio/chain/block.hpp>
 #include <eosio/chain/genesis_state.hpp>
+#include <functional>
 
 namespace eosio { namespace chain {
 
    namespace detail { class block_log_impl; }
 
+   enum class block_log_compression {
+      none,
+      zlib
+   };
+
+   struct block_log_config {
+      /**
+       * When set, read_block_by_num and get_block_pos are served from read-only memory mappings of blocks.log
+       * and blocks.index instead of the shared file streams, so that reads from several threads run in parallel.
+       * Either way these may be called from other threads while the main thread appends; stream reads take turns.
+       */
+      bool mmap_reads = false;
+
+      /**
+       * When non-zero, blocks.log and blocks.index are rotated out to retained_dir as blocks-<first>-<last>.log and
+       * blocks-<first>-<last>.index after every block whose number is a multiple of stride, and a new blocks.log is
+       * started. Each stride file is a complete version 2 block log with its own index.
+       */
+      uint32_t stride = 0;
+      /// maximum number of stride files kept in retained_dir; older ones are moved to archive_dir or deleted
+      uint32_t max_retained_files = std::numeric_limits<uint32_t>::max();
+      /**
+       * Location of stride files, empty for the blocks directory. On another file system a rotated file is copied to it
+       * by a background thread and read from the blocks directory until the copy is complete.
+       */
+      fc::path retained_dir;
+      /// where stride files beyond max_retained_files are moved, by a background thread, empty to delete them
+      fc::path archive_dir;
+
+      /**
+       * When non-zero, only the most recent prune_blocks blocks are guaranteed to be kept. Stride files holding only
+       * older blocks are removed, or moved to archive_dir, as blocks are appended, so first_block_num() advances in
+       * steps of the stride, which must be non-zero.
+       */
+      uint32_t prune_blocks = 0;
+
+      /**
+       * Compression of blocks appended to block log files created from now on. Any compression stores the file as
+       * version 3, where every block entry is compressed on its own so that blocks.index still gives O(1) access.
+       */
+      block_log_compression compression = block_log_compression::none;
+
+      /// threads verifying blocks while an index is reconstructed, 0 for one per core
+      uint16_t index_threads = 0;
+
+      /**
+       * When set, append only queues the block and a dedicated thread writes the queued blocks in batches, one write
+       * per file for each batch. Queued blocks are returned by read_block_by_num until they are written. As the
+       * thread owns the file streams, this implies mmap_reads.
+       */
+      bool async_append = false;
+      /// number of queued blocks at which an asynchronous append waits for the writer thread
+      uint32_t max_pending_blocks = 1024;
+      /// fsync blocks.log and blocks.index after every write; with async_append once per batch
+      bool fsync_appends = false;
+
+      /// bytes of serialized blocks kept deserialized in an LRU cache of recently read and appended blocks, 0 to disable
+      uint64_t cache_size = 0;
+   };
+
+   struct block_log_cache_stats {
+      uint64_t hits   = 0;
+      uint64_t misses = 0;
+      uint32_t blocks = 0; ///< blocks currently cached
+      uint64_t size   = 0; ///< serialized size of the cached blocks
+   };
+
    /* The block log is an external append only log of the blocks with a header. Blocks should only
     * be written to the log after they irreverisble as the log is append only. The log is a doubly
     * linked list of blocks. There is a secondary index file of only block positions that enables
@@ -32,17 +100,23 @@ namespace eosio { namespace chain {
     * Blocks can be accessed at random via block number through the index file. Seek to 8 * (block_num - 1)
     * to find the position of the block in the main file.
     *
-    * The main file is the only file that needs to persist. The index file can be reconstructed during a
-    * linear scan of the main file.
+    * The main file is the only file that needs to persist. The index file can be reconstructed by following
+    * the trailing positions back from the head block, after which the indexed blocks are verified in parallel.
+    *
+    * With a configured stride the log is split into stride files, each laid out as above with its own index. The
+    * stride files present in the retained directory form the catalog used to dispatch reads of older blocks, so
+    * reconstruction and repair only ever touch the file that is damaged.
     */
 
    class block_log {
       public:
-         block_log(const fc::path& data_dir);
+         block_log(const fc::path& data_dir, const block_log_config& cfg = block_log_config());
          block_log(block_log&& other);
          ~block_log();
 
+         /// returns the position of the block in blocks.log, or npos if it was queued for asynchronous append
          uint64_t append(const signed_block_ptr& b);
+         /// with async_append, waits until all queued blocks are written and rethrows a failure of the writer thread
          void flush();
          void reset( const genesis_state& gs, const signed_block_ptr& genesis_block, uint32_t first_block_num = 1 );
 
@@ -53,27 +127,44 @@ namespace eosio { namespace chain {
          }
 
          /**
-          * Return offset of block in file, or block_log::npos if it does not exist.
+          * Return offset of block in blocks.log, or block_log::npos if it does not exist there. Blocks that were
+          * rotated out to stride files have no offset in blocks.log.
           */
          uint64_t get_block_pos(uint32_t block_num) const;
          signed_block_ptr        read_head()const;
          const signed_block_ptr& head()const;
+         /**
+          * Number of the last block written to the files, and fsynced with fsync_appends, 0 if there is none. With
+          * async_append the blocks after it are only queued, and are lost should the node stop before they are written.
+          */
+         uint32_t                written_head_num()const;
          uint32_t                first_block_num() const;
 
+         block_log_cache_stats   get_cache_stats() const;
+
          static const uint64_t npos = std::numeric_limits<uint64_t>::max();
 
          static const uint32_t min_supported_version;
          static const uint32_t max_supported_version;
 
-         static fc::path repair_log( const fc::path& data_dir, uint32_t truncate_at_block = 0 );
+         /// retained_dir is the configured block_log_config::retained_dir, whose stride files are kept when it lies within data_dir
+         static fc::path repair_log( const fc::path& data_dir, uint32_t truncate_at_block = 0, const fc::path& retained_dir = fc::path() );
 
          static genesis_state extract_genesis_state( const fc::path& data_dir );
 
+         /// called periodically during index reconstruction with the number of blocks verified so far
+         using index_progress_callback = std::function<void(uint32_t verified, uint32_t total)>;
+
+         static void construct_index( const fc::path& block_file_name, const fc::path& index_file_name,
+                                      uint16_t num_threads = 0, const index_progress_callback& progress = {} );
+
       private:
-         void open(const fc::path& data_dir);
+         void open(const fc::path& data_dir, const block_log_config& cfg);
          void construct_index();
 
          std::unique_ptr<detail::block_log_impl> my;
    };
 
 } }
+
+FC_REFLECT( eosio::chain::block_log_cache_stats, (hits)(misses)(blocks)(size) )
@@ -1,5 +1,6 @@
 #pragma once
 #include <eosio/chain/block_state.hpp>
+#include <eosio/chain/block_log.hpp>
 #include <eosio/chain/trace.hpp>
 #include <eosio/chain/genesis_state.hpp>
 #include <chainbase/pinnable_mapped_file.hpp>
@@ -52,6 +53,11 @@ namespace eosio { namespace chain {
       LIGHT
    };
 
+   enum class reversible_blocks_store {
+      database,  ///< chainbase database in the reversible blocks directory
+      ring_file  ///< reversible_block_log, a ring file with an in-memory index
+   };
+
    class controller {
       public:
 
@@ -64,13 +70,16 @@ namespace eosio { namespace chain {
             flat_set< pair<account_name, action_name> > action_blacklist;
             flat_set<public_key_type> key_blacklist;
             path                     blocks_dir             =  chain::config::default_blocks_dir_name;
+            block_log_config         blog_config;
             path                     state_dir              =  chain::config::default_state_dir_name;
             uint64_t                 state_size             =  chain::config::default_state_size;
             uint64_t                 state_guard_size       =  chain::config::default_state_guard_size;
             uint64_t                 reversible_cache_size  =  chain::config::default_reversible_cache_size;
             uint64_t                 reversible_guard_size  =  chain::config::default_reversible_guard_size;
+            reversible_blocks_store  reversible_store       =  reversible_blocks_store::database;
             uint32_t                 sig_cpu_bill_pct       =  chain::config::default_sig_cpu_bill_pct;
             uint16_t                 thread_pool_size       =  chain::config::default_controller_thread_pool_size;
+            uint32_t                 replay_prefetch_blocks =  chain::config::default_replay_prefetch_blocks; ///< 0 reads blocks inline
             bool                     read_only              =  false;
             bool                     force_all_checks       =  false;
             bool                     disable_replay_opts    =  false;
@@ -80,6 +89,7 @@ namespace eosio { namespace chain {
 
             genesis_state            genesis;
             wasm_interface::vm_type  wasm_runtime = chain::config::default_wasm_runtime;
+            wasm_interface_config    wasm_config;
 
             db_read_mode             read_mode              = db_read_mode::SPECULATIVE;
             validation_mode          block_validation_mode  = validation_mode::FULL;
@@ -140,6 +150,14 @@ namespace eosio { namespace chain {
           */
          unapplied_transactions_type& get_unapplied_transactions();
 
+         /**
+          *  Starts compiling the contracts that the context free actions and actions of trx are sent to on the wasm
+          *  compile thread, if there is one, so that they are ready by the time trx is pushed. Only looks up the
+          *  receivers; trx is not validated. What is compiled ahead is evicted first when the instantiation cache is
+          *  full, so that it does not displace contracts in use.
+          */
+         void precompile_contracts( const transaction_metadata_ptr& trx );
+
          /**
           *
           */
@@ -227,6 +245,8 @@ namespace eosio { namespace chain {
 
          block_id_type get_block_id_for_num( uint32_t block_num )const;
 
+         block_log_cache_stats get_block_cache_stats()const;
+
          sha256 calculate_integrity_hash()const;
          void write_snapshot( const snapshot_writer_ptr& snapshot )const;
 
@@ -297,6 +317,7 @@ namespace eosio { namespace chain {
 
          const apply_handler* find_apply_handler( account_name contract, scope_name scope, action_name act )const;
          wasm_interface& get_wasm_interface();
+         const wasm_interface& get_wasm_interface()const;
 
 
          optional<abi_serializer> get_abi_serializer( account_name n, const fc::microseconds& max_serialization_time )const {
@@ -0,0 +1,56 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+#include <fc/filesystem.hpp>
+#include <eosio/chain/block.hpp>
+
+namespace eosio { namespace chain {
+
+   namespace detail { class reversible_block_log_impl; }
+
+   /* The reversible block log is an alternative to the reversible blocks database. Blocks that were applied but are
+    * not yet irreversible are appended to a ring file of fixed capacity and located through an in-memory index by
+    * block number, so storing a block costs one write and no undo bookkeeping.
+    *
+    * +--------+-------------+---------+-----------+----------+-----------------+-------------+
+    * | Header | dead ...    | Block n | Block n+1 | Truncate | Block n+1 (new) | free ...    |
+    * |        |             |         |           | at n+1   |                 |             |
+    * +--------+-------------+---------+-----------+----------+-----------------+-------------+
+    *           ^ reused once      ^ start of the live records, kept in the header
+    *             writing wraps
+    *
+    * Every record carries a sequence number and a checksum. Removing blocks up to the last irreversible block only
+    * moves the start of the live records forward; removing the newest blocks appends a truncate record. On open the
+    * index is rebuilt by following the records from the start kept in the header until the sequence breaks.
+    */
+   class reversible_block_log {
+      public:
+         reversible_block_log( const fc::path& file, uint64_t capacity, bool read_only = false );
+         reversible_block_log( reversible_block_log&& other );
+         ~reversible_block_log();
+
+         /// stores b, replacing any stored block with the same or a higher block number
+         void add( const signed_block_ptr& b );
+         /// removes the blocks numbered block_num and higher
+         void remove_from( uint32_t block_num );
+         /// removes the blocks numbered up to and including block_num
+         void remove_through( uint32_t block_num );
+         void remove_all();
+
+         signed_block_ptr             read_block( uint32_t block_num )const;
+         optional<block_id_type>      read_block_id( uint32_t block_num )const;
+
+         bool                         empty()const;
+         uint32_t                     first_block_num()const; ///< 0 if empty
+         uint32_t                     last_block_num()const;  ///< 0 if empty
+
+         /// bytes that can still be written before the ring reaches the oldest stored block
+         uint64_t                     free_space()const;
+
+      private:
+         std::unique_ptr<detail::reversible_block_log_impl> my;
+   };
+
+} }
@@ -5,6 +5,9 @@
 
 namespace eosio { namespace chain {
 
+   class table_id_object;
+   struct key_value_object;
+
    struct deadline_timer {
          deadline_timer();
          ~deadline_timer();
@@ -140,6 +143,17 @@ namespace eosio { namespace chain {
          fc::microseconds              billing_timer_duration_limit;
 
          deadline_timer                _deadline_timer;
+
+         /// Contract tables and primary index rows looked up by the actions of this transaction. Tables are only
+         /// created and removed through apply_context, which keeps the entries up to date, and rows keep their address
+         /// until they are removed, so the entries stay valid until the transaction is undone.
+         struct row_key_hash {
+            size_t operator()( const pair<int64_t, uint64_t>& k )const {
+               return std::hash<uint64_t>()( uint64_t(k.first) * 0x9E3779B97F4A7C15ull ^ k.second );
+            }
+         };
+         flat_map<std::tuple<account_name, scope_name, table_name>, const table_id_object*>      table_lookups;
+         unordered_map<pair<int64_t, uint64_t>, const key_value_object*, row_key_hash>        row_lookups;
    };
 
 } }
@@ -233,20 +233,65 @@ namespace eosio { namespace chain { namespace wasm_injections {
    struct checktime_injection {
       static constexpr bool kills = false;
       static constexpr bool post = true;
-      static void init() {
+      static void init( uint32_t interval = 0 ) {
          idx = 0;
          chktm_idx = 0;
+         counter_interval = interval;
+         counter_global_idx = -1;
       }
       static void accept( wasm_ops::instr* inst, wasm_ops::visitor_arg& arg ) {
          auto mapped_index = injector_utils::injected_index_mapping.find(chktm_idx);
+         insert( arg.new_code, mapped_index->second );
+      }
+
+      static void add_counter( IR::Module& mod ) {
+         if ( counter_interval == 0 )
+            return;
+         mod.globals.defs.push_back({{ValueType::i32, true}, {(I32) counter_interval}});
+         counter_global_idx = mod.globals.size()-1;
+      }
+
+      /* inserts a call to checktime, or with a counter_interval, a decrement of the counter global that calls
+       * checktime and starts the count over every counter_interval times it runs */
+      static void insert( wasm_ops::instruction_stream* code, uint32_t checktime_index ) {
+         wasm_ops::op_types<>::call_t chktm;
+         chktm.field = checktime_index;
+         if ( counter_interval == 0 ) {
+            chktm.pack(code);
+            return;
+         }
+
+         wasm_ops::op_types<>::get_global_t get_global_inst;
+         wasm_ops::op_types<>::set_global_t set_global_inst;
+         wasm_ops::op_types<>::i32_const_t one_inst;
+         wasm_ops::op_types<>::i32_const_t interval_inst;
+         wasm_ops::op_types<>::i32_sub_t sub_inst;
+         wasm_ops::op_types<>::i32_eqz_t eqz_inst;
+         wasm_ops::op_types<>::if__t if_inst;
+         wasm_ops::op_types<>::end_t end_inst;
+
+         get_global_inst.field = counter_global_idx;
+         set_global_inst.field = counter_global_idx;
+         one_inst.field = 1;
+         interval_inst.field = counter_interval;
 
-         wasm_ops::op_types<>::call_t chktm; 
-         chktm.field = mapped_index->second;
-         chktm.pack(arg.new_code);
+         get_global_inst.pack(code);
+         one_inst.pack(code);
+         sub_inst.pack(code);
+         set_global_inst.pack(code);
+         get_global_inst.pack(code);
+         eqz_inst.pack(code);
+         if_inst.pack(code);
+         interval_inst.pack(code);
+         set_global_inst.pack(code);
+         chktm.pack(code);
+         end_inst.pack(code);
       }
 
       static int32_t idx;
       static int32_t chktm_idx;
+      static uint32_t counter_interval;
+      static int32_t counter_global_idx;
    };
 
    struct fix_call_index {
@@ -285,7 +330,6 @@ namespace eosio { namespace chain { namespace wasm_injections {
          injector_utils::add_import<ResultType::none>(*(arg.module), "call_depth_assert", assert_idx);
 
          wasm_ops::op_types<>::call_t call_assert;
-         wasm_ops::op_types<>::call_t call_checktime;
          wasm_ops::op_types<>::get_global_t get_global_inst; 
          wasm_ops::op_types<>::set_global_t set_global_inst;
 
@@ -297,7 +341,6 @@ namespace eosio { namespace chain { namespace wasm_injections {
          wasm_ops::op_types<>::else__t else_inst; 
 
          call_assert.field = assert_idx;
-         call_checktime.field = checktime_injection::chktm_idx;
          get_global_inst.field = global_idx;
          set_global_inst.field = global_idx;
          const_inst.field = -1;
@@ -331,7 +374,7 @@ namespace eosio { namespace chain { namespace wasm_injections {
          INSERT_INJECTED(const_inst);
          INSERT_INJECTED(add_inst);
          INSERT_INJECTED(set_global_inst);
-         INSERT_INJECTED(call_checktime);
+         checktime_injection::insert( arg.new_code, checktime_injection::chktm_idx );
 
 #undef INSERT_INJECTED
       }
@@ -778,11 +821,13 @@ namespace eosio { namespace chain { namespace wasm_injections {
       using standard_module_injectors = module_injectors< max_memory_injection_visitor >;
 
       public:
-         wasm_binary_injection( IR::Module& mod )  : _module( &mod ) { 
+         /* with a checktime_interval, checktime is called every checktime_interval loop iterations and function calls
+          * instead of on each one */
+         wasm_binary_injection( IR::Module& mod, uint32_t checktime_interval = 0 )  : _module( &mod ) { 
             _module_injectors.init();
             // initialize static fields of injectors
             injector_utils::init( mod );
-            checktime_injection::init();
+            checktime_injection::init( checktime_interval );
             call_depth_check_and_insert_checktime::init();
          }
 
@@ -790,6 +835,7 @@ namespace eosio { namespace chain { namespace wasm_injections {
             _module_injectors.inject( *_module );
             // inject checktime first
             injector_utils::add_import<ResultType::none>( *_module, u8"checktime", checktime_injection::chktm_idx );
+            checktime_injection::add_counter( *_module );
 
             for ( auto& fd : _module->functions.defs ) {
                wasm_ops::EOSIO_OperatorDecoderStream<pre_op_injectors> pre_decoder(fd.code);
@@ -813,9 +859,7 @@ namespace eosio { namespace chain { namespace wasm_injections {
                wasm_ops::EOSIO_OperatorDecoderStream<post_op_injectors> post_decoder(fd.code);
                wasm_ops::instruction_stream post_code(fd.code.size()*2);
 
-               wasm_ops::op_types<>::call_t chktm; 
-               chktm.field = injector_utils::injected_index_mapping.find(checktime_injection::chktm_idx)->second;
-               chktm.pack(&post_code);
+               checktime_injection::insert( &post_code, injector_utils::injected_index_mapping.find(checktime_injection::chktm_idx)->second );
 
                while ( post_decoder ) {
                   auto op = post_decoder.decodeOp();
@@ -16,6 +16,61 @@ namespace eosio { namespace chain {
       int32_t code = 0;
    };
 
+   struct wasm_interface_config {
+      /**
+       * When set, the machine code the wavm runtime generates for a contract is stored in this directory and loaded
+       * instead of being generated again when the contract is instantiated later, including after a restart.
+       */
+      fc::path  wavm_code_cache_dir;
+      /// least recently used entries of the code cache are removed once it grows beyond this many bytes
+      uint64_t  wavm_code_cache_size = 1024*1024*1024ull;
+      /**
+       * When 1, new contracts are compiled on a background thread, 0 compiles a contract when it first runs. Higher
+       * values are treated as 1: wavm compiles under a single LLVM context, so compiles cannot overlap.
+       */
+      uint16_t  compile_threads = 0;
+      /// number of actions a contract runs before it is compiled again in the background: with the JIT in tiered mode,
+      /// at wavm_hot_opt_level with wavm
+      uint32_t  tier_up_threshold = 100;
+      /// optimization level of the code wavm generates, from 0 (generated fastest) to 2 (runs fastest)
+      uint8_t   wavm_opt_level = 1;
+      /// when higher than wavm_opt_level, the level contracts are compiled at once they have run tier_up_threshold actions
+      uint8_t   wavm_hot_opt_level = 0;
+      /**
+       * When set, the code injected into contracts counts loop iterations and function calls in a global and calls
+       * checktime once every checktime_interval of them rather than on each one. A deadline is then noticed up to
+       * that many iterations late.
+       */
+      uint32_t  checktime_interval = 0;
+      /// contracts evicted from the instantiation cache keep their injected code in memory up to this many bytes, so
+      /// that instantiating them again does not parse and inject them again
+      uint64_t  injected_code_cache_size = 64*1024*1024ull;
+      /**
+       * Instantiated contracts beyond this many bytes are evicted, those that cost the least to compile again per byte
+       * and use first. A contract is counted as the size of its injected code and initial memory.
+       */
+      uint64_t  instantiation_cache_size = 512*1024*1024ull;
+   };
+
+   struct wasm_contract_stats {
+      digest_type       code_hash;
+      uint8_t           vm_type = 0;
+      uint8_t           vm_version = 0;
+      bool              tiered_up = false; ///< compiled again after it ran tier_up_threshold actions
+      fc::microseconds  compile_time;      ///< including compiling it again
+      fc::microseconds  execution_time;
+      uint64_t          actions = 0;
+   };
+
+   struct wasm_cache_stats {
+      uint64_t  entries = 0;
+      uint64_t  size = 0;      ///< as counted against wasm_interface_config::instantiation_cache_size
+      uint64_t  hits = 0;      ///< actions that found their contract instantiated
+      uint64_t  misses = 0;    ///< actions that had to instantiate their contract or wait for it
+      uint64_t  evictions = 0;
+      uint64_t  injections = 0; ///< contracts parsed and injected, rather than found in the injected code cache
+   };
+
    namespace webassembly { namespace common {
       class intrinsics_accessor;
 
@@ -73,10 +128,11 @@ namespace eosio { namespace chain {
       public:
          enum class vm_type {
             wavm,
-            wabt
+            wabt,
+            tiered ///< wabt, moving contracts to wavm once they are run often
          };
 
-         wasm_interface(vm_type vm, const chainbase::database& db);
+         wasm_interface(vm_type vm, const chainbase::database& db, const wasm_interface_config& cfg = wasm_interface_config());
          ~wasm_interface();
 
          //call before dtor to skip what can be minutes of dtor overhead with some runtimes; can cause leaks
@@ -85,6 +141,12 @@ namespace eosio { namespace chain {
          //validates code -- does a WASM validation pass and checks the wasm against EOSIO specific constraints
          static void validate(const controller& control, const bytes& code);
 
+         //starts compiling the given code in the background, if the runtime supports it, so it is ready when first run
+         void precompile(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version);
+
+         //whether precompile would start compiling the given code: it is not cached yet and the runtime supports it
+         bool needs_precompile(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version)const;
+
          //indicate that a particular code probably won't be used after given block_num
          void code_block_num_last_used(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version, const uint32_t& block_num);
 
@@ -97,6 +159,11 @@ namespace eosio { namespace chain {
          //Immediately exits currently running wasm. UB is called when no wasm running
          void exit();
 
+         //compile and execution times of the contracts currently cached
+         vector<wasm_contract_stats> get_contract_stats()const;
+
+         wasm_cache_stats get_cache_stats()const;
+
       private:
          unique_ptr<struct wasm_interface_impl> my;
          friend class eosio::chain::webassembly::common::intrinsics_accessor;
@@ -108,4 +175,6 @@ namespace eosio{ namespace chain {
    std::istream& operator>>(std::istream& in, wasm_interface::vm_type& runtime);
 }}
 
-FC_REFLECT_ENUM( eosio::chain::wasm_interface::vm_type, (wavm)(wabt) )
+FC_REFLECT_ENUM( eosio::chain::wasm_interface::vm_type, (wavm)(wabt)(tiered) )
+FC_REFLECT( eosio::chain::wasm_contract_stats, (code_hash)(vm_type)(vm_version)(tiered_up)(compile_time)(execution_time)(actions) )
+FC_REFLECT( eosio::chain::wasm_cache_stats, (entries)(size)(hits)(misses)(evictions)(injections) )
@@ -8,8 +8,16 @@
 #include <eosio/chain/transaction_context.hpp>
 #include <eosio/chain/code_object.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/thread_utils.hpp>
 #include <fc/scoped_exit.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+
 #include "IR/Module.h"
 #include "Runtime/Intrinsics.h"
 #include "Platform/Platform.h"
@@ -24,7 +32,69 @@ using boost::multi_index_container;
 
 namespace eosio { namespace chain {
 
+   /**
+    * Holds the code of recently instantiated contracts after injection, along with their initial memory, so that
+    * instantiating one again after it was evicted from the instantiation cache skips parsing and injecting it.
+    * Least recently used entries are dropped beyond max_size bytes. Used from the compile threads as well.
+    */
+   class injected_code_cache {
+      public:
+         struct injected_code {
+            std::vector<U8>       bytes;
+            std::vector<uint8_t>  initial_memory;
+         };
+         typedef std::tuple<digest_type, uint8_t, uint8_t> key_type;
+
+         explicit injected_code_cache( uint64_t max_size ) : max_size(max_size) {}
+
+         std::shared_ptr<const injected_code> get( const key_type& key ) {
+            std::lock_guard<std::mutex> g(mtx);
+            auto it = entries.find(key);
+            if( it == entries.end() )
+               return {};
+            lru.splice(lru.begin(), lru, it->second.lru_it);
+            return it->second.code;
+         }
+
+         void put( const key_type& key, std::shared_ptr<const injected_code> code ) {
+            const uint64_t size = code->bytes.size() + code->initial_memory.size();
+            if( size > max_size )
+               return;
+            std::lock_guard<std::mutex> g(mtx);
+            if( entries.count(key) )
+               return;
+            lru.push_front(key);
+            entries.emplace(key, entry{std::move(code), size, lru.begin()});
+            total_size += size;
+            while( total_size > max_size ) {
+               auto it = entries.find(lru.back());
+               total_size -= it->second.size;
+               entries.erase(it);
+               lru.pop_back();
+            }
+         }
+
+      private:
+         struct entry {
+            std::shared_ptr<const injected_code>  code;
+            uint64_t                              size;
+            std::list<key_type>::iterator         lru_it;
+         };
+
+         std::mutex                     mtx;
+         std::map<key_type, entry>      entries;
+         std::list<key_type>            lru; ///< most recently used first
+         uint64_t                       total_size = 0;
+         const uint64_t                 max_size;
+   };
+
    struct wasm_interface_impl {
+      struct compiled_module {
+         std::unique_ptr<wasm_instantiated_module_interface>  module;
+         fc::microseconds                                     compile_time;
+         uint64_t                                             size = 0; ///< of the injected code and initial memory
+      };
+
       struct wasm_cache_entry {
          digest_type                                          code_hash;
          uint32_t                                             first_block_num_used;
@@ -32,26 +102,69 @@ namespace eosio { namespace chain {
          std::unique_ptr<wasm_instantiated_module_interface>  module;
          uint8_t                                              vm_type = 0;
          uint8_t                                              vm_version = 0;
+         /// the module while it is compiled on the compile threads; when tiering up, the module replacing the current one
+         std::future<compiled_module>                         pending_module;
+         /// compiled by precompile and not run yet, so the setcode that stored the code may have been undone; checked
+         /// once first_block_num_used is irreversible
+         bool                                                 precompiled = false;
+         /// the runtime that instantiated module
+         wasm_runtime_interface*                              runtime = nullptr;
+         bool                                                 tier_up_failed = false;
+         fc::microseconds                                     compile_time;
+         mutable fc::microseconds                             execution_time;
+         uint64_t                                             actions = 0;
+         /// counted against the cache size; the size of the code while a precompiled module is compiled, 0 until module
+         /// is set otherwise
+         uint64_t                                             size = 0;
+         /// the cache's eviction clock when the entry was last used, see eviction_priority
+         double                                               clock_when_used = 0;
+         /// eviction_priority of the entry, updated along with the members it is computed from
+         double                                               priority = 0;
       };
       struct by_hash;
       struct by_first_block_num;
       struct by_last_block_num;
-
-      wasm_interface_impl(wasm_interface::vm_type vm, const chainbase::database& d) : db(d) {
-         if(vm == wasm_interface::vm_type::wavm)
-            runtime_interface = std::make_unique<webassembly::wavm::wavm_runtime>();
+      struct by_precompiled;
+      struct by_priority;
+
+      wasm_interface_impl(wasm_interface::vm_type vm, const chainbase::database& d, const wasm_interface_config& cfg)
+      : max_cache_size(cfg.instantiation_cache_size), injected_codes(cfg.injected_code_cache_size), db(d) {
+         const uint8_t hot_opt_level = std::max(cfg.wavm_opt_level, cfg.wavm_hot_opt_level);
+         if(vm == wasm_interface::vm_type::wavm) {
+            runtime_interface = std::make_unique<webassembly::wavm::wavm_runtime>(cfg);
+            //contracts run often enough are compiled again with more optimization in the background
+            if(hot_opt_level > cfg.wavm_opt_level)
+               jit_runtime = std::make_unique<webassembly::wavm::wavm_runtime>(cfg, hot_opt_level);
+         }
          else if(vm == wasm_interface::vm_type::wabt)
             runtime_interface = std::make_unique<webassembly::wabt_runtime::wabt_runtime>();
+         else if(vm == wasm_interface::vm_type::tiered) {
+            //contracts start out in the interpreter, those run often enough are compiled in the background
+            runtime_interface = std::make_unique<webassembly::wabt_runtime::wabt_runtime>();
+            jit_runtime = std::make_unique<webassembly::wavm::wavm_runtime>(cfg, hot_opt_level);
+         }
          else
             EOS_THROW(wasm_exception, "wasm_interface_impl fall through");
+         tier_up_threshold = cfg.tier_up_threshold;
+         checktime_interval = cfg.checktime_interval;
+
+         //compiles hold the one LLVM context wavm has, so a second compile thread would only wait for the first
+         if(jit_runtime || (cfg.compile_threads > 0 && runtime_interface->supports_background_instantiation()))
+            compile_pool.emplace("wasm", 1);
       }
 
       ~wasm_interface_impl() {
-         if(is_shutting_down)
+         if(compile_pool)
+            compile_pool->stop();
+         if(is_shutting_down) {
             for(wasm_cache_index::iterator it = wasm_instantiation_cache.begin(); it != wasm_instantiation_cache.end(); ++it)
                wasm_instantiation_cache.modify(it, [](wasm_cache_entry& e) {
                   e.module.release();
                });
+            for(auto& pending : abandoned_modules)
+               if(pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                  try { pending.get().module.release(); } catch(...) {}
+         }
       }
 
       std::vector<uint8_t> parse_initial_memory(const Module& module) {
@@ -82,7 +195,163 @@ namespace eosio { namespace chain {
 
       void current_lib(uint32_t lib) {
          //anything last used before or on the LIB can be evicted
-         wasm_instantiation_cache.get<by_last_block_num>().erase(wasm_instantiation_cache.get<by_last_block_num>().begin(), wasm_instantiation_cache.get<by_last_block_num>().upper_bound(lib));
+         auto& by_last_used = wasm_instantiation_cache.get<by_last_block_num>();
+         for(auto it = by_last_used.begin(); it != by_last_used.end() && it->last_block_num_used <= lib;)
+            it = evict(by_last_used, it);
+
+         //as can code compiled ahead for a setcode that was undone before it ran; precompiled code whose first block
+         //became irreversible is checked once, after which it is kept like any other
+         auto& by_precompiled_block = wasm_instantiation_cache.get<by_precompiled>();
+         for(auto it = by_precompiled_block.lower_bound(boost::make_tuple(true));
+             it != by_precompiled_block.end() && it->first_block_num_used <= lib;) {
+            if(db.find<code_object,by_code_hash>(boost::make_tuple(it->code_hash, it->vm_type, it->vm_version))) {
+               auto next = std::next(it);
+               by_precompiled_block.modify(it, [](auto& c) {
+                  c.precompiled = false;
+               });
+               it = next;
+            } else
+               it = evict(by_precompiled_block, it);
+         }
+
+         enforce_cache_size(nullptr);
+         release_abandoned_modules();
+         runtime_interface->collect_garbage();
+         if(jit_runtime)
+            jit_runtime->collect_garbage();
+      }
+
+      template<typename Index, typename Iterator>
+      Iterator evict(Index& index, Iterator it) {
+         dlog("evicting contract ${s}", ("s", get_stats(*it)));
+         if(it->pending_module.valid()) {
+            //the module still compiling is destroyed on this thread once it is ready, see release_abandoned_modules
+            index.modify(it, [&](auto& c) {
+               abandoned_modules.push_back(std::move(c.pending_module));
+            });
+         }
+         cache_size -= it->size;
+         ++cache_stats.evictions;
+         return index.erase(it);
+      }
+
+      //destroys the modules that evicted entries were compiling once the compile threads are done with them
+      void release_abandoned_modules() {
+         for(auto it = abandoned_modules.begin(); it != abandoned_modules.end();) {
+            if(it->wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+               ++it;
+               continue;
+            }
+            try {
+               it->get();
+            } catch(...) {}
+            it = abandoned_modules.erase(it);
+         }
+      }
+
+      //Greedy-Dual-Size-Frequency: entries that took long to compile and are used often per byte they take are kept.
+      //The clock moves up to the priority of each evicted entry, so that entries used since then outrank those that
+      //were used often a long time ago.
+      double eviction_priority(const wasm_cache_entry& e)const {
+         return e.clock_when_used + double(std::max<uint64_t>(e.actions, 1)) * double(std::max<int64_t>(e.compile_time.count(), 1))
+                                    / double(std::max<uint64_t>(e.size, 1));
+      }
+
+      //evicts entries other than keep, lowest priority first, until the cache fits in max_cache_size
+      void enforce_cache_size(const wasm_cache_entry* keep) {
+         auto& by_lowest_priority = wasm_instantiation_cache.get<by_priority>();
+         for(auto it = by_lowest_priority.begin(); cache_size > max_cache_size && it != by_lowest_priority.end();) {
+            if(&*it == keep) {
+               ++it;
+               continue;
+            }
+            eviction_clock = it->priority;
+            it = evict(by_lowest_priority, it);
+         }
+      }
+
+      bool needs_precompile(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version)const {
+         return compile_pool && runtime_interface->supports_background_instantiation()
+                && wasm_instantiation_cache.find(boost::make_tuple(code_hash, vm_type, vm_version)) == wasm_instantiation_cache.end();
+      }
+
+      void precompile(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version) {
+         if(!needs_precompile(code_hash, vm_type, vm_version))
+            return;
+
+         const code_object& codeobject = db.get<code_object,by_code_hash>(boost::make_tuple(code_hash, vm_type, vm_version));
+         //the database must not be read from the compile threads
+         auto code = std::make_shared<std::vector<char>>(codeobject.code.begin(), codeobject.code.end());
+         auto it = wasm_instantiation_cache.emplace( wasm_interface_impl::wasm_cache_entry{
+                                              .code_hash = code_hash,
+                                              .first_block_num_used = codeobject.first_block_used,
+                                              .last_block_num_used = UINT32_MAX,
+                                              .module = nullptr,
+                                              .vm_type = vm_type,
+                                              .vm_version = vm_version,
+                                              .pending_module = async_thread_pool(compile_pool->get_executor(), [this, code, code_hash, vm_type, vm_version]() {
+                                                 return instantiate(*runtime_interface, {code_hash, vm_type, vm_version}, code->data(), code->size());
+                                              }),
+                                              .precompiled = true,
+                                              .runtime = runtime_interface.get()
+                                           } ).first;
+         //counts against the cache size and competes for it like any other entry while it compiles, so that compiling
+         //ahead cannot grow the cache beyond max_cache_size
+         wasm_instantiation_cache.modify(it, [&](auto& c) {
+            c.size = code->size();
+            c.clock_when_used = eviction_clock;
+            c.priority = eviction_priority(c);
+         });
+         cache_size += it->size;
+         enforce_cache_size(nullptr);
+      }
+
+      //parses, injects and instantiates code, or instantiates the injected code kept from an earlier instantiation;
+      //called on the compile threads as well as the main thread
+      compiled_module instantiate(wasm_runtime_interface& runtime, const injected_code_cache::key_type& key, const char* code, size_t code_size) {
+         const auto start = fc::time_point::now();
+         auto injected = injected_codes.get(key);
+         if(!injected) {
+            ++injections;
+            injected = inject(code, code_size);
+            injected_codes.put(key, injected);
+         }
+         auto instance = runtime.instantiate_module((const char*)injected->bytes.data(), injected->bytes.size(), injected->initial_memory);
+         return {std::move(instance), fc::time_point::now() - start, injected->bytes.size() + injected->initial_memory.size()};
+      }
+
+      std::shared_ptr<const injected_code_cache::injected_code> inject(const char* code, size_t code_size) {
+         IR::Module module;
+         try {
+            Serialization::MemoryInputStream stream((const U8*)code, code_size);
+            WASM::serialize(stream, module);
+            module.userSections.clear();
+         } catch(const Serialization::FatalSerializationException& e) {
+            EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+         } catch(const IR::ValidationException& e) {
+            EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+         }
+
+         {
+            //the injectors keep their state in static members
+            static std::mutex injection_mtx;
+            std::lock_guard<std::mutex> g(injection_mtx);
+            wasm_injections::wasm_binary_injection injector(module, checktime_interval);
+            injector.inject();
+         }
+
+         std::vector<U8> bytes;
+         try {
+            Serialization::ArrayOutputStream outstream;
+            WASM::serialize(outstream, module);
+            bytes = outstream.getBytes();
+         } catch(const Serialization::FatalSerializationException& e) {
+            EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+         } catch(const IR::ValidationException& e) {
+            EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+         }
+
+         return std::make_shared<injected_code_cache::injected_code>(injected_code_cache::injected_code{std::move(bytes), parse_initial_memory(module)});
       }
 
       const std::unique_ptr<wasm_instantiated_module_interface>& get_instantiated_module( const digest_type& code_hash, const uint8_t& vm_type,
@@ -100,52 +369,94 @@ namespace eosio { namespace chain {
                                                       .last_block_num_used = UINT32_MAX,
                                                       .module = nullptr,
                                                       .vm_type = vm_type,
-                                                      .vm_version = vm_version
+                                                      .vm_version = vm_version,
+                                                      .pending_module = {},
+                                                      .precompiled = false,
+                                                      .runtime = runtime_interface.get()
                                                    } ).first;
          }
 
-         if(!it->module) {
-            if(!codeobject)
-               codeobject = &db.get<code_object,by_code_hash>(boost::make_tuple(code_hash, vm_type, vm_version));
+         if(it->precompiled) {
+            wasm_instantiation_cache.modify(it, [](auto& c) {
+               c.precompiled = false;
+            });
+         }
 
+         if(it->module)
+            ++cache_stats.hits;
+         else {
+            ++cache_stats.misses;
             auto timer_pause = fc::make_scoped_exit([&](){
                trx_context.resume_billing_timer();
             });
             trx_context.pause_billing_timer();
-            IR::Module module;
-            try {
-               Serialization::MemoryInputStream stream((const U8*)codeobject->code.data(), codeobject->code.size());
-               WASM::serialize(stream, module);
-               module.userSections.clear();
-            } catch(const Serialization::FatalSerializationException& e) {
-               EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
-            } catch(const IR::ValidationException& e) {
-               EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
-            }
-
-            wasm_injections::wasm_binary_injection injector(module);
-            injector.inject();
 
-            std::vector<U8> bytes;
-            try {
-               Serialization::ArrayOutputStream outstream;
-               WASM::serialize(outstream, module);
-               bytes = outstream.getBytes();
-            } catch(const Serialization::FatalSerializationException& e) {
-               EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
-            } catch(const IR::ValidationException& e) {
-               EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+            compiled_module compiled;
+            if(it->pending_module.valid()) {
+               //only waits for the part of the compilation that did not overlap with earlier transactions
+               std::future<compiled_module> pending;
+               wasm_instantiation_cache.modify(it, [&](auto& c) {
+                  pending = std::move(c.pending_module);
+               });
+               //a failure on the compile threads is not the transaction's; it compiles again below and fails only
+               //should that fail as well
+               try {
+                  compiled = pending.get();
+               } catch(const fc::exception& e) {
+                  wlog("compiling contract ${h} in the background failed, compiling it again: ${e}", ("h", code_hash)("e", e.to_detail_string()));
+               } catch(...) {
+                  wlog("compiling contract ${h} in the background failed, compiling it again", ("h", code_hash));
+               }
             }
+            if(!compiled.module) {
+               if(!codeobject)
+                  codeobject = &db.get<code_object,by_code_hash>(boost::make_tuple(code_hash, vm_type, vm_version));
 
-            wasm_instantiation_cache.modify(it, [&](auto& c) {
-               c.module = runtime_interface->instantiate_module((const char*)bytes.data(), bytes.size(), parse_initial_memory(module));
-            });
+               compiled = instantiate(*runtime_interface, {code_hash, vm_type, vm_version}, codeobject->code.data(), codeobject->code.size());
+            }
+            set_module(it, std::move(compiled));
+            enforce_cache_size(&*it);
          }
+         else if(jit_runtime && it->runtime != jit_runtime.get() && !it->tier_up_failed)
+            tier_up(it);
+
+         wasm_instantiation_cache.modify(it, [&](auto& c) {
+            ++c.actions;
+            c.clock_when_used = eviction_clock;
+            c.priority = eviction_priority(c);
+         });
+         executing_runtime = it->runtime;
+         executing_entry = &*it;
          return it->module;
       }
 
+      wasm_contract_stats get_stats(const wasm_cache_entry& e)const {
+         return {e.code_hash, e.vm_type, e.vm_version, jit_runtime && e.runtime == jit_runtime.get(), e.compile_time, e.execution_time, e.actions};
+      }
+
+      vector<wasm_contract_stats> get_contract_stats()const {
+         vector<wasm_contract_stats> stats;
+         stats.reserve(wasm_instantiation_cache.size());
+         for(const auto& e : wasm_instantiation_cache)
+            stats.push_back(get_stats(e));
+         return stats;
+      }
+
       bool is_shutting_down = false;
       std::unique_ptr<wasm_runtime_interface> runtime_interface;
+      std::unique_ptr<wasm_runtime_interface> jit_runtime; ///< runtime contracts are moved to once run tier_up_threshold times
+      wasm_runtime_interface* executing_runtime = nullptr;
+      const wasm_cache_entry* executing_entry = nullptr;
+      uint32_t tier_up_threshold = 0;
+      uint32_t checktime_interval = 0;
+      uint64_t max_cache_size = 0;
+      uint64_t cache_size = 0; ///< sum of the entries' sizes
+      double eviction_clock = 0;
+      wasm_cache_stats cache_stats;
+      std::atomic<uint64_t> injections{0}; ///< wasm_cache_stats::injections, counted on the compile threads as well
+      injected_code_cache injected_codes;
+      fc::optional<named_thread_pool> compile_pool;
+      std::list<std::future<compiled_module>> abandoned_modules; ///< compiled for entries evicted before they were ready
 
       typedef boost::multi_index_container<
          wasm_cache_entry,
@@ -158,11 +469,65 @@ namespace eosio { namespace chain {
                >
             >,
             ordered_non_unique<tag<by_first_block_num>, member<wasm_cache_entry, uint32_t, &wasm_cache_entry::first_block_num_used>>,
-            ordered_non_unique<tag<by_last_block_num>, member<wasm_cache_entry, uint32_t, &wasm_cache_entry::last_block_num_used>>
+            ordered_non_unique<tag<by_last_block_num>, member<wasm_cache_entry, uint32_t, &wasm_cache_entry::last_block_num_used>>,
+            ordered_non_unique<tag<by_precompiled>,
+               composite_key< wasm_cache_entry,
+                  member<wasm_cache_entry, bool,     &wasm_cache_entry::precompiled>,
+                  member<wasm_cache_entry, uint32_t, &wasm_cache_entry::first_block_num_used>
+               >
+            >,
+            ordered_non_unique<tag<by_priority>, member<wasm_cache_entry, double, &wasm_cache_entry::priority>>
          >
       > wasm_cache_index;
       wasm_cache_index wasm_instantiation_cache;
 
+      void set_module(wasm_cache_index::iterator it, compiled_module&& compiled) {
+         cache_size = cache_size - it->size + compiled.size;
+         wasm_instantiation_cache.modify(it, [&](auto& c) {
+            c.module = std::move(compiled.module);
+            c.compile_time += compiled.compile_time;
+            c.size = compiled.size;
+            c.priority = eviction_priority(c);
+         });
+      }
+
+      //starts compiling a contract with jit_runtime once it has run tier_up_threshold times, and swaps the compiled
+      //module in between actions once it is ready
+      void tier_up(wasm_cache_index::iterator it) {
+         if(!it->pending_module.valid()) {
+            if(it->actions < tier_up_threshold)
+               return;
+            const code_object& codeobject = db.get<code_object,by_code_hash>(boost::make_tuple(it->code_hash, it->vm_type, it->vm_version));
+            auto code = std::make_shared<std::vector<char>>(codeobject.code.begin(), codeobject.code.end());
+            injected_code_cache::key_type key{it->code_hash, it->vm_type, it->vm_version};
+            wasm_instantiation_cache.modify(it, [&](auto& c) {
+               c.pending_module = async_thread_pool(compile_pool->get_executor(), [this, code, key]() {
+                  return instantiate(*jit_runtime, key, code->data(), code->size());
+               });
+            });
+            return;
+         }
+
+         if(it->pending_module.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return;
+         std::future<compiled_module> pending;
+         wasm_instantiation_cache.modify(it, [&](auto& c) {
+            pending = std::move(c.pending_module);
+         });
+         try {
+            set_module(it, pending.get());
+            wasm_instantiation_cache.modify(it, [&](auto& c) {
+               c.runtime = jit_runtime.get();
+            });
+         } catch(const fc::exception& e) {
+            wlog("compiling contract ${h} again failed, it keeps running as before: ${e}", ("h", it->code_hash)("e", e.to_detail_string()));
+            wasm_instantiation_cache.modify(it, [](auto& c) { c.tier_up_failed = true; });
+         } catch(...) {
+            wlog("compiling contract ${h} again failed, it keeps running as before", ("h", it->code_hash));
+            wasm_instantiation_cache.modify(it, [](auto& c) { c.tier_up_failed = true; });
+         }
+      }
+
       const chainbase::database& db;
    };
 
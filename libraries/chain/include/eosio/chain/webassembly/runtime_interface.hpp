@@ -17,6 +17,13 @@ class wasm_runtime_interface {
    public:
       virtual std::unique_ptr<wasm_instantiated_module_interface> instantiate_module(const char* code_bytes, size_t code_size, std::vector<uint8_t> initial_memory) = 0;
 
+      //whether instantiate_module may be called from another thread while modules run on the main thread
+      virtual bool supports_background_instantiation() const { return false; }
+
+      //frees what the modules destroyed while an instantiation was in progress left behind; called on the main thread
+      //between transactions
+      virtual void collect_garbage() {}
+
       //immediately exit the currently running wasm_instantiated_module_interface. Yep, this assumes only one can possibly run at a time.
       virtual void immediately_exit_currently_running_module() = 0;
 
@@ -6,6 +6,8 @@
 #include <eosio/chain/apply_context.hpp>
 #include <softfloat_types.h>
 
+#include <cstring>
+
 //wabt includes
 #include <src/binary-reader.h>
 #include <src/common.h>
@@ -78,11 +80,10 @@ inline array_ptr<T> array_ptr_impl (wabt_apply_instance_vars& vars, uint32_t ptr
 inline null_terminated_ptr null_terminated_ptr_impl(wabt_apply_instance_vars& vars, uint32_t ptr)
 {
    char *value = vars.get_validated_pointer(ptr, 1);
-   const char* p = value;
    const char* const top_of_memory = vars.memory->data.data() + vars.memory->data.size();
-   while(p < top_of_memory)
-      if(*p++ == '\0')
-         return null_terminated_ptr(value);
+   //memchr scans a word or vector at a time rather than a byte at a time
+   if(::memchr(value, '\0', top_of_memory - value))
+      return null_terminated_ptr(value);
 
    FC_THROW_EXCEPTION(wasm_execution_error, "unterminated string");
 }
@@ -8,6 +8,8 @@
 #include "Runtime/Runtime.h"
 #include "IR/Types.h"
 
+#include <cstring>
+
 
 namespace eosio { namespace chain { namespace webassembly { namespace wavm {
 
@@ -16,13 +18,26 @@ using namespace Runtime;
 using namespace fc;
 using namespace eosio::chain::webassembly::common;
 
+namespace detail { class wavm_code_cache; }
+
 class wavm_runtime : public eosio::chain::wasm_runtime_interface {
    public:
-      wavm_runtime();
+      wavm_runtime(const wasm_interface_config& cfg = wasm_interface_config());
+      /// generates code at opt_level rather than cfg.wavm_opt_level
+      wavm_runtime(const wasm_interface_config& cfg, uint8_t opt_level);
       ~wavm_runtime();
       std::unique_ptr<wasm_instantiated_module_interface> instantiate_module(const char* code_bytes, size_t code_size, std::vector<uint8_t> initial_memory) override;
 
       void immediately_exit_currently_running_module() override;
+
+      bool supports_background_instantiation() const override { return true; }
+
+      void collect_garbage() override;
+
+   private:
+      /// shared by the runtimes using the same directory
+      std::shared_ptr<detail::wavm_code_cache> code_cache;
+      OptimizationLevel                        opt_level;
 };
 
 //This is a temporary hack for the single threaded implementation
@@ -49,8 +64,6 @@ inline array_ptr<T> array_ptr_impl (running_instance_context& ctx, U32 ptr, size
    size_t mem_total = IR::numBytesPerPage * Runtime::getMemoryNumPages(mem);
    if (ptr >= mem_total || length > (mem_total - ptr) / sizeof(T))
       Runtime::causeException(Exception::Cause::accessViolation);
-   
-   T* ret_ptr = (T*)(getMemoryBaseAddress(mem) + ptr);
 
    return array_ptr<T>((T*)(getMemoryBaseAddress(mem) + ptr));
 }
@@ -64,12 +77,11 @@ inline null_terminated_ptr null_terminated_ptr_impl(running_instance_context& ct
    if(!mem)
       Runtime::causeException(Exception::Cause::accessViolation);
 
-   char *value                     = (char*)(getMemoryBaseAddress(mem) + ptr);
-   const char* p                   = value;
-   const char* const top_of_memory = (char*)(getMemoryBaseAddress(mem) + IR::numBytesPerPage*Runtime::getMemoryNumPages(mem));
-   while(p < top_of_memory)
-      if(*p++ == '\0')
-         return null_terminated_ptr(value);
+   char* const base                = (char*)getMemoryBaseAddress(mem);
+   const size_t mem_total          = IR::numBytesPerPage*Runtime::getMemoryNumPages(mem);
+   //memchr scans a word or vector at a time rather than a byte at a time
+   if(ptr < mem_total && ::memchr(base + ptr, '\0', mem_total - ptr))
+      return null_terminated_ptr(base + ptr);
 
    Runtime::causeException(Exception::Cause::accessViolation);
 }
@@ -0,0 +1,380 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include <eosio/chain/reversible_block_log.hpp>
+#include <eosio/chain/exceptions.hpp>
+#include <fc/io/raw.hpp>
+#include <boost/crc.hpp>
+#include <cstring>
+#include <map>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace eosio { namespace chain {
+
+   namespace detail {
+
+      struct ring_file_header {
+         uint32_t version = 0;
+         uint32_t reserved = 0;
+         uint64_t capacity = 0;
+         uint64_t first_offset = 0; ///< offset of the oldest live record, or of the next record if there is none
+         uint64_t first_seq = 0;    ///< sequence number expected at first_offset
+      };
+      static_assert( sizeof(ring_file_header) == 32, "ring_file_header must not be padded" );
+
+      enum class ring_record_type : uint32_t {
+         block    = 1,
+         truncate = 2, ///< blocks numbered block_num and higher were removed
+         wrap     = 3  ///< the next record starts right after the file header
+      };
+
+      struct ring_record_header {
+         uint32_t magic = 0;
+         uint32_t type = 0;
+         uint64_t seq = 0;
+         uint32_t block_num = 0;
+         uint32_t size = 0;      ///< size of the packed block following this header
+         uint32_t checksum = 0;  ///< crc32 of this header, with checksum 0, and the packed block
+         uint32_t reserved = 0;
+      };
+      static_assert( sizeof(ring_record_header) == 32, "ring_record_header must not be padded" );
+
+      class reversible_block_log_impl {
+         public:
+            static constexpr uint32_t version = 1;
+            static constexpr uint32_t record_magic = 0x52424c4b;
+            static constexpr uint64_t data_start = sizeof(ring_file_header);
+
+            struct entry {
+               uint64_t offset = 0;
+               uint32_t size = 0;
+               uint64_t seq = 0;
+            };
+
+            fc::path                    file;
+            int                         fd = -1;
+            bool                        read_only = false;
+            uint64_t                    capacity = 0;
+            uint64_t                    write_pos = data_start;
+            uint64_t                    next_seq = 1;
+            std::map<uint32_t, entry>   index;
+
+            ~reversible_block_log_impl() {
+               if( fd >= 0 )
+                  ::close( fd );
+            }
+
+            void open( uint64_t requested_capacity );
+            void create( uint64_t new_capacity );
+            void load();
+
+            void read_at( uint64_t offset, char* data, size_t size )const;
+            void write_at( uint64_t offset, const char* data, size_t size );
+
+            static uint32_t checksum( ring_record_header h, const char* data, size_t size );
+            bool read_record( uint64_t offset, uint64_t expected_seq, ring_record_header& h, std::vector<char>& data )const;
+            void write_record( ring_record_type type, uint32_t block_num, const std::vector<char>& data );
+
+            uint64_t first_live_offset()const { return index.empty() ? write_pos : index.begin()->second.offset; }
+            uint64_t first_live_seq()const    { return index.empty() ? next_seq : index.begin()->second.seq; }
+            void update_header();
+
+            /// offset a record of record_size bytes can be written at without overwriting live records
+            uint64_t place( uint64_t record_size )const;
+      };
+
+      void reversible_block_log_impl::read_at( uint64_t offset, char* data, size_t size )const {
+         while( size > 0 ) {
+            const auto r = ::pread( fd, data, size, offset );
+            EOS_ASSERT( r > 0, reversible_blocks_exception, "Unable to read from reversible block log ${f}: ${e}",
+                        ("f", file.generic_string())("e", r == 0 ? std::string("unexpected end of file") : std::string(strerror(errno))) );
+            data += r;
+            offset += r;
+            size -= r;
+         }
+      }
+
+      void reversible_block_log_impl::write_at( uint64_t offset, const char* data, size_t size ) {
+         EOS_ASSERT( !read_only, reversible_blocks_exception, "Reversible block log ${f} was opened read only", ("f", file.generic_string()) );
+         while( size > 0 ) {
+            const auto r = ::pwrite( fd, data, size, offset );
+            EOS_ASSERT( r > 0, reversible_blocks_exception, "Unable to write to reversible block log ${f}: ${e}",
+                        ("f", file.generic_string())("e", strerror(errno)) );
+            data += r;
+            offset += r;
+            size -= r;
+         }
+      }
+
+      uint32_t reversible_block_log_impl::checksum( ring_record_header h, const char* data, size_t size ) {
+         h.checksum = 0;
+         boost::crc_32_type crc;
+         crc.process_bytes( &h, sizeof(h) );
+         crc.process_bytes( data, size );
+         return crc.checksum();
+      }
+
+      bool reversible_block_log_impl::read_record( uint64_t offset, uint64_t expected_seq, ring_record_header& h, std::vector<char>& data )const {
+         if( offset + sizeof(h) > capacity )
+            return false;
+         read_at( offset, (char*)&h, sizeof(h) );
+         if( h.magic != record_magic || h.seq != expected_seq || offset + sizeof(h) + h.size > capacity )
+            return false;
+         data.resize( h.size );
+         if( h.size )
+            read_at( offset + sizeof(h), data.data(), data.size() );
+         return h.checksum == checksum( h, data.data(), data.size() );
+      }
+
+      void reversible_block_log_impl::update_header() {
+         ring_file_header h;
+         h.version = version;
+         h.capacity = capacity;
+         h.first_offset = first_live_offset();
+         h.first_seq = first_live_seq();
+         write_at( 0, (const char*)&h, sizeof(h) );
+      }
+
+      uint64_t reversible_block_log_impl::place( uint64_t record_size )const {
+         EOS_ASSERT( record_size <= capacity - data_start, reversible_guard_exception,
+                     "Block of ${s} bytes does not fit into the reversible block log of ${c} bytes", ("s", record_size)("c", capacity) );
+         const bool fits_before_end = write_pos + record_size <= capacity;
+         if( index.empty() )
+            return fits_before_end ? write_pos : data_start;
+
+         const uint64_t first = first_live_offset();
+         if( first < write_pos ) {
+            if( fits_before_end )
+               return write_pos;
+            if( data_start + record_size < first )
+               return data_start;
+         } else if( write_pos + record_size < first ) {
+            return write_pos;
+         }
+         EOS_THROW( reversible_guard_exception, "Reversible block log is full, ${f} bytes are in use",
+                    ("f", capacity - data_start) );
+      }
+
+      void reversible_block_log_impl::write_record( ring_record_type type, uint32_t block_num, const std::vector<char>& data ) {
+         ring_record_header h;
+         h.magic = record_magic;
+         h.type = static_cast<uint32_t>(type);
+         h.block_num = block_num;
+         h.size = data.size();
+
+         const uint64_t pos = place( sizeof(h) + data.size() );
+         if( pos != write_pos && write_pos + sizeof(h) <= capacity ) {
+            // tell readers to continue at the start, a tail too short for a header is skipped without a marker
+            ring_record_header wrap;
+            wrap.magic = record_magic;
+            wrap.type = static_cast<uint32_t>(ring_record_type::wrap);
+            wrap.seq = next_seq++;
+            wrap.checksum = checksum( wrap, nullptr, 0 );
+            write_at( write_pos, (const char*)&wrap, sizeof(wrap) );
+         }
+
+         h.seq = next_seq++;
+         h.checksum = checksum( h, data.data(), data.size() );
+         std::vector<char> record( sizeof(h) + data.size() );
+         memcpy( record.data(), &h, sizeof(h) );
+         if( !data.empty() )
+            memcpy( record.data() + sizeof(h), data.data(), data.size() );
+         write_at( pos, record.data(), record.size() );
+         write_pos = pos + record.size();
+
+         if( type == ring_record_type::block ) {
+            const bool first_changed = index.empty() || block_num <= index.begin()->first;
+            index.erase( index.lower_bound( block_num ), index.end() );
+            index[block_num] = entry{ pos, h.size, h.seq };
+            if( first_changed )
+               update_header();
+         }
+      }
+
+      void reversible_block_log_impl::create( uint64_t new_capacity ) {
+         capacity = new_capacity;
+         write_pos = data_start;
+         next_seq = 1;
+         index.clear();
+         EOS_ASSERT( ::ftruncate( fd, capacity ) == 0, reversible_blocks_exception,
+                     "Unable to size reversible block log ${f}: ${e}", ("f", file.generic_string())("e", strerror(errno)) );
+         update_header();
+      }
+
+      void reversible_block_log_impl::load() {
+         ring_file_header h;
+         read_at( 0, (char*)&h, sizeof(h) );
+         EOS_ASSERT( h.version == version, reversible_blocks_exception,
+                     "Unsupported version ${v} of reversible block log ${f}", ("v", h.version)("f", file.generic_string()) );
+         EOS_ASSERT( h.capacity > data_start && h.first_offset >= data_start && h.first_offset <= h.capacity,
+                     reversible_blocks_exception, "Header of reversible block log ${f} is corrupt", ("f", file.generic_string()) );
+         capacity = h.capacity;
+
+         uint64_t pos = h.first_offset;
+         uint64_t seq = h.first_seq;
+         uint64_t scanned = 0;
+         ring_record_header rh;
+         std::vector<char> data;
+         while( scanned < capacity ) {
+            if( pos + sizeof(rh) > capacity ) {
+               scanned += capacity - pos;
+               pos = data_start;
+            }
+            if( !read_record( pos, seq, rh, data ) )
+               break;
+            ++seq;
+
+            switch( static_cast<ring_record_type>(rh.type) ) {
+               case ring_record_type::wrap:
+                  scanned += capacity - pos;
+                  pos = data_start;
+                  continue;
+               case ring_record_type::block:
+                  index.erase( index.lower_bound( rh.block_num ), index.end() );
+                  index[rh.block_num] = entry{ pos, rh.size, rh.seq };
+                  break;
+               case ring_record_type::truncate:
+                  index.erase( index.lower_bound( rh.block_num ), index.end() );
+                  break;
+               default:
+                  EOS_THROW( reversible_blocks_exception, "Unknown record type ${t} in reversible block log ${f}",
+                             ("t", rh.type)("f", file.generic_string()) );
+            }
+            pos += sizeof(rh) + rh.size;
+            scanned += sizeof(rh) + rh.size;
+         }
+
+         write_pos = pos;
+         next_seq = seq;
+      }
+
+      void reversible_block_log_impl::open( uint64_t requested_capacity ) {
+         const bool exists = fc::exists( file );
+         EOS_ASSERT( exists || !read_only, reversible_blocks_exception,
+                     "Reversible block log ${f} does not exist", ("f", file.generic_string()) );
+         if( !fc::is_directory( file.parent_path() ) )
+            fc::create_directories( file.parent_path() );
+
+         fd = ::open( file.generic_string().c_str(), read_only ? O_RDONLY : (O_RDWR | O_CREAT), 0644 );
+         EOS_ASSERT( fd >= 0, reversible_blocks_exception, "Unable to open reversible block log ${f}: ${e}",
+                     ("f", file.generic_string())("e", strerror(errno)) );
+
+         if( !exists || fc::file_size( file ) < data_start ) {
+            create( requested_capacity );
+            return;
+         }
+
+         load();
+         ilog( "Reversible block log holds ${n} blocks", ("n", index.size()) );
+
+         if( capacity != requested_capacity && !read_only ) {
+            // the live blocks are few, resize by writing them again into a fresh ring
+            ilog( "Resizing reversible block log from ${o} to ${n} bytes", ("o", capacity)("n", requested_capacity) );
+            std::vector<std::vector<char>> blocks;
+            std::vector<uint32_t> block_nums;
+            for( const auto& item : index ) {
+               std::vector<char> data( item.second.size );
+               read_at( item.second.offset + sizeof(ring_record_header), data.data(), data.size() );
+               blocks.emplace_back( std::move(data) );
+               block_nums.push_back( item.first );
+            }
+            create( requested_capacity );
+            for( size_t i = 0; i < blocks.size(); ++i )
+               write_record( ring_record_type::block, block_nums[i], blocks[i] );
+         }
+      }
+   }
+
+   reversible_block_log::reversible_block_log( const fc::path& file, uint64_t capacity, bool read_only )
+   :my( new detail::reversible_block_log_impl() ) {
+      my->file = file;
+      my->read_only = read_only;
+      my->open( capacity );
+   }
+
+   reversible_block_log::reversible_block_log( reversible_block_log&& other ) {
+      my = std::move(other.my);
+   }
+
+   reversible_block_log::~reversible_block_log() {}
+
+   void reversible_block_log::add( const signed_block_ptr& b ) {
+      my->write_record( detail::ring_record_type::block, b->block_num(), fc::raw::pack( *b ) );
+   }
+
+   void reversible_block_log::remove_from( uint32_t block_num ) {
+      auto itr = my->index.lower_bound( block_num );
+      if( itr == my->index.end() )
+         return;
+      my->index.erase( itr, my->index.end() );
+      if( my->index.empty() ) {
+         // nothing before the removed blocks is live, a new start makes the truncate record unnecessary
+         my->update_header();
+      } else {
+         my->write_record( detail::ring_record_type::truncate, block_num, {} );
+      }
+   }
+
+   void reversible_block_log::remove_through( uint32_t block_num ) {
+      if( my->index.empty() || my->index.begin()->first > block_num )
+         return;
+      my->index.erase( my->index.begin(), my->index.upper_bound( block_num ) );
+      my->update_header();
+   }
+
+   void reversible_block_log::remove_all() {
+      if( my->index.empty() )
+         return;
+      my->index.clear();
+      my->update_header();
+   }
+
+   signed_block_ptr reversible_block_log::read_block( uint32_t block_num )const {
+      auto itr = my->index.find( block_num );
+      if( itr == my->index.end() )
+         return {};
+      std::vector<char> data( itr->second.size );
+      my->read_at( itr->second.offset + sizeof(detail::ring_record_header), data.data(), data.size() );
+      fc::datastream<const char*> ds( data.data(), data.size() );
+      auto result = std::make_shared<signed_block>();
+      fc::raw::unpack( ds, *result );
+      return result;
+   }
+
+   optional<block_id_type> reversible_block_log::read_block_id( uint32_t block_num )const {
+      auto itr = my->index.find( block_num );
+      if( itr == my->index.end() )
+         return {};
+      // the header is enough for the id, avoid unpacking the transactions
+      std::vector<char> data( itr->second.size );
+      my->read_at( itr->second.offset + sizeof(detail::ring_record_header), data.data(), data.size() );
+      fc::datastream<const char*> ds( data.data(), data.size() );
+      block_header h;
+      fc::raw::unpack( ds, h );
+      return h.id();
+   }
+
+   bool reversible_block_log::empty()const {
+      return my->index.empty();
+   }
+
+   uint32_t reversible_block_log::first_block_num()const {
+      return my->index.empty() ? 0 : my->index.begin()->first;
+   }
+
+   uint32_t reversible_block_log::last_block_num()const {
+      return my->index.empty() ? 0 : my->index.rbegin()->first;
+   }
+
+   uint64_t reversible_block_log::free_space()const {
+      const uint64_t usable = my->capacity - my->data_start;
+      if( my->index.empty() )
+         return usable;
+      const uint64_t first = my->first_live_offset();
+      const uint64_t used = first < my->write_pos ? my->write_pos - first : usable - (first - my->write_pos);
+      return usable - used;
+   }
+
+} } /// eosio::chain
@@ -442,6 +442,8 @@ namespace bacc = boost::accumulators;
    }
 
    void transaction_context::undo() {
+      table_lookups.clear();
+      row_lookups.clear();
       if (undo_session) undo_session->undo();
    }
 
@@ -29,7 +29,7 @@ namespace eosio { namespace chain {
    using namespace webassembly;
    using namespace webassembly::common;
 
-   wasm_interface::wasm_interface(vm_type vm, const chainbase::database& d) : my( new wasm_interface_impl(vm, d) ) {}
+   wasm_interface::wasm_interface(vm_type vm, const chainbase::database& d, const wasm_interface_config& cfg) : my( new wasm_interface_impl(vm, d, cfg) ) {}
 
    wasm_interface::~wasm_interface() {}
 
@@ -52,15 +52,23 @@ namespace eosio { namespace chain {
       root_resolver resolver( pso.whitelisted_intrinsics );
       LinkResult link_result = linkModule(module, resolver);
 
-      //there are a couple opportunties for improvement here--
+      //there is an opportunity for improvement here--
       //Easy: Cache the Module created here so it can be reused for instantiaion
-      //Hard: Kick off instantiation in a separate thread at this location
+      //instantiation is kicked off on the compile threads by precompile once setcode has stored the code
 	 }
 
    void wasm_interface::indicate_shutting_down() {
       my->is_shutting_down = true;
    }
 
+   void wasm_interface::precompile(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version) {
+      my->precompile(code_hash, vm_type, vm_version);
+   }
+
+   bool wasm_interface::needs_precompile(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version)const {
+      return my->needs_precompile(code_hash, vm_type, vm_version);
+   }
+
    void wasm_interface::code_block_num_last_used(const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version, const uint32_t& block_num) {
       my->code_block_num_last_used(code_hash, vm_type, vm_version, block_num);
    }
@@ -70,11 +78,29 @@ namespace eosio { namespace chain {
    }
 
    void wasm_interface::apply( const digest_type& code_hash, const uint8_t& vm_type, const uint8_t& vm_version, apply_context& context ) {
-      my->get_instantiated_module(code_hash, vm_type, vm_version, context.trx_context)->apply(context);
+      const auto& module = my->get_instantiated_module(code_hash, vm_type, vm_version, context.trx_context);
+      const auto& entry = *my->executing_entry;
+      const auto start = fc::time_point::now();
+      auto record_time = fc::make_scoped_exit([&](){
+         entry.execution_time += fc::time_point::now() - start;
+      });
+      module->apply(context);
+   }
+
+   vector<wasm_contract_stats> wasm_interface::get_contract_stats()const {
+      return my->get_contract_stats();
+   }
+
+   wasm_cache_stats wasm_interface::get_cache_stats()const {
+      auto stats = my->cache_stats;
+      stats.entries = my->wasm_instantiation_cache.size();
+      stats.size = my->cache_size;
+      stats.injections = my->injections;
+      return stats;
    }
 
    void wasm_interface::exit() {
-      my->runtime_interface->immediately_exit_currently_running_module();
+      my->executing_runtime->immediately_exit_currently_running_module();
    }
 
    wasm_instantiated_module_interface::~wasm_instantiated_module_interface() {}
@@ -1971,6 +1997,8 @@ std::istream& operator>>(std::istream& in, wasm_interface::vm_type& runtime) {
       runtime = eosio::chain::wasm_interface::vm_type::wavm;
    else if (s == "wabt")
       runtime = eosio::chain::wasm_interface::vm_type::wabt;
+   else if (s == "tiered")
+      runtime = eosio::chain::wasm_interface::vm_type::tiered;
    else
       in.setstate(std::ios_base::failbit);
    return in;
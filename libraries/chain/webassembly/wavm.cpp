@@ -12,8 +12,19 @@
 #include "Runtime/Linker.h"
 #include "Runtime/Intrinsics.h"
 
-#include <vector>
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <fstream>
 #include <iterator>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 using namespace IR;
 using namespace Runtime;
@@ -31,69 +42,247 @@ struct wavm_runtime_initializer {
 
 using live_module_ref = std::list<ObjectInstance*>::iterator;
 
+/**
+ * Modules may be instantiated on the compile thread while others run on the main thread. WAVM does not allow
+ * instantiation and garbage collection to overlap, so both happen under instantiation_mtx. Garbage collection only
+ * runs on the main thread, where modules are removed and no contract runs meanwhile: a removal that finds an
+ * instantiation in progress leaves it to collect_pending_garbage rather than waiting.
+ * The runtime's lists of tables and memories, which a trap in a running contract looks up, have their own lock.
+ */
 struct wavm_live_modules {
+   //the instance returned by f is a live module before any garbage collection can run
+   template<typename F>
+   std::pair<ModuleInstance*, live_module_ref> instantiate(F&& f) {
+      std::lock_guard<std::mutex> g(instantiation_mtx);
+      ModuleInstance* module_instance = f();
+      EOS_ASSERT(module_instance != nullptr, wasm_exception, "Fail to Instantiate WAVM Module");
+      auto ref = add_live_module(module_instance);
+      return {module_instance, ref};
+   }
+
    live_module_ref add_live_module(ModuleInstance* module_instance) {
+      std::lock_guard<std::mutex> g(live_modules_mtx);
       return live_modules.insert(live_modules.begin(), asObject(module_instance));
    }
 
+   //main thread only
    void remove_live_module(live_module_ref it) {
-      live_modules.erase(it);
-      run_wavm_garbage_collection();
+      {
+         std::lock_guard<std::mutex> g(live_modules_mtx);
+         live_modules.erase(it);
+      }
+      gc_pending = true;
+      collect_pending_garbage();
    }
 
+   //main thread only
+   void collect_pending_garbage() {
+      if(!gc_pending)
+         return;
+      std::unique_lock<std::mutex> g(instantiation_mtx, std::try_to_lock);
+      if(g)
+         run_wavm_garbage_collection();
+   }
+
+   //must hold instantiation_mtx
    void run_wavm_garbage_collection() {
+      gc_pending = false;
       //need to pass in a mutable list of root objects we want the garbage collector to retain
       std::vector<ObjectInstance*> root;
-      std::copy(live_modules.begin(), live_modules.end(), std::back_inserter(root));
+      {
+         std::lock_guard<std::mutex> g(live_modules_mtx);
+         std::copy(live_modules.begin(), live_modules.end(), std::back_inserter(root));
+      }
       Runtime::freeUnreferencedObjects(std::move(root));
    }
 
+   std::mutex                 instantiation_mtx;
+   std::atomic<bool>          gc_pending{false};
+   std::mutex                 live_modules_mtx;
    std::list<ObjectInstance*> live_modules;
 };
 
 static wavm_live_modules the_wavm_live_modules;
 
+/**
+ * On-disk store of the machine code generated for modules, one file per cache key. Every file starts with a checksum
+ * of the code it holds, so that a file left incomplete by a crash is discarded instead of loaded. Files are written
+ * under a temporary name and renamed into place. The least recently used files are removed once the total size
+ * exceeds max_size; the modification time of a file records its last use across restarts.
+ */
+class wavm_code_cache : public Runtime::ObjectCache {
+   public:
+      wavm_code_cache( const fc::path& dir, uint64_t max_size ) : dir(dir), max_size(max_size) {
+         fc::create_directories( dir );
+
+         std::vector<std::pair<std::time_t, std::string>> found;
+         for( fc::directory_iterator itr( dir ), end_itr; itr != end_itr; ++itr ) {
+            const fc::path p = *itr;
+            if( !fc::is_regular_file( p ) )
+               continue;
+            const auto extension = p.extension().generic_string();
+            if( extension == tmp_extension ) {
+               fc::remove( p ); // left over from an interrupted write
+               continue;
+            }
+            if( extension != object_extension )
+               continue; // not ours
+
+            found.emplace_back( boost::filesystem::last_write_time( p.generic_string() ), p.stem().generic_string() );
+         }
+         std::sort( found.begin(), found.end() );
+         for( const auto& f : found ) {
+            const uint64_t size = fc::file_size( object_file( f.second ) );
+            lru.push_front( f.second );
+            entries.emplace( f.second, entry{ size, lru.begin() } );
+            total_size += size;
+         }
+         evict();
+         ilog( "wavm code cache in ${dir} holds ${n} modules, ${s} bytes",
+               ("dir", dir.generic_string())("n", entries.size())("s", total_size) );
+      }
+
+      std::vector<U8> getObject( const std::string& key ) override {
+         std::lock_guard<std::mutex> g( mtx );
+         auto itr = entries.find( key );
+         if( itr == entries.end() )
+            return {};
+
+         const fc::path file = object_file( key );
+         std::vector<U8> object;
+         try {
+            std::ifstream in( file.generic_string(), std::ios::in | std::ios::binary );
+            fc::sha256 checksum;
+            in.read( checksum.data(), checksum.data_size() );
+            object.resize( itr->second.size > checksum.data_size() ? itr->second.size - checksum.data_size() : 0 );
+            in.read( (char*)object.data(), object.size() );
+            if( !in || object.empty() || fc::sha256::hash( (const char*)object.data(), object.size() ) != checksum ) {
+               wlog( "discarding corrupt wavm code cache entry ${f}", ("f", file.generic_string()) );
+               erase( itr );
+               return {};
+            }
+            boost::filesystem::last_write_time( file.generic_string(), std::time(nullptr) );
+         } catch( ... ) {
+            erase( itr );
+            return {};
+         }
+         lru.splice( lru.begin(), lru, itr->second.lru_itr );
+         return object;
+      }
+
+      void putObject( const std::string& key, const std::vector<U8>& object ) override {
+         std::lock_guard<std::mutex> g( mtx );
+         const uint64_t size = sizeof(fc::sha256) + object.size();
+         if( size > max_size || entries.count( key ) )
+            return;
+
+         try {
+            const fc::path file = object_file( key );
+            const fc::path tmp = dir / (key + tmp_extension);
+            {
+               std::ofstream out( tmp.generic_string(), std::ios::out | std::ios::binary | std::ios::trunc );
+               const auto checksum = fc::sha256::hash( (const char*)object.data(), object.size() );
+               out.write( checksum.data(), checksum.data_size() );
+               out.write( (const char*)object.data(), object.size() );
+               out.flush();
+               EOS_ASSERT( out.good(), wasm_exception, "unable to write ${f}", ("f", tmp.generic_string()) );
+            }
+            fc::rename( tmp, file );
+         } FC_LOG_AND_DROP();
+
+         if( !fc::exists( object_file( key ) ) )
+            return;
+         lru.push_front( key );
+         entries.emplace( key, entry{ size, lru.begin() } );
+         total_size += size;
+         evict();
+      }
+
+   private:
+      struct entry {
+         uint64_t                         size;
+         std::list<std::string>::iterator lru_itr;
+      };
+      using entry_map = std::unordered_map<std::string, entry>;
+
+      static constexpr const char* object_extension = ".o";
+      /// of files being written, which are removed on startup; other files in dir are left alone
+      static constexpr const char* tmp_extension = ".wavm-code-tmp";
+
+      fc::path object_file( const std::string& key )const { return dir / (key + object_extension); }
+
+      void erase( entry_map::iterator itr ) {
+         fc::remove( object_file( itr->first ) );
+         total_size -= itr->second.size;
+         lru.erase( itr->second.lru_itr );
+         entries.erase( itr );
+      }
+
+      void evict() {
+         while( total_size > max_size && !lru.empty() )
+            erase( entries.find( lru.back() ) );
+      }
+
+      fc::path                 dir;
+      uint64_t                 max_size;
+      uint64_t                 total_size = 0;
+      std::list<std::string>   lru; ///< most recently used first
+      entry_map                entries;
+      std::mutex               mtx;
+};
+
 }
 
 class wavm_instantiated_module : public wasm_instantiated_module_interface {
    public:
-      wavm_instantiated_module(ModuleInstance* instance, std::unique_ptr<Module> module, std::vector<uint8_t> initial_mem) :
+      wavm_instantiated_module(ModuleInstance* instance, detail::live_module_ref module_ref, std::unique_ptr<Module> module, std::vector<uint8_t> initial_mem) :
          _initial_memory(initial_mem),
          _instance(instance),
-         _module_ref(detail::the_wavm_live_modules.add_live_module(instance))
+         _module_ref(module_ref),
+         _apply(asFunctionNullable(getInstanceExport(instance, "apply")))
       {
          //The memory instance is reused across all wavm_instantiated_modules, but for wasm instances
          // that didn't declare "memory", getDefaultMemory() won't see it. It would also be possible
          // to say something like if(module->memories.size()) here I believe
-         if(getDefaultMemory(_instance))
+         if(getDefaultMemory(_instance)) {
             _initial_memory_config = module->memories.defs.at(0).type;
+            //an image lets each call map the initial memory copy-on-write instead of clearing and copying it; without
+            // one (unsupported platform, or data beyond the minimum size) calls fall back to the copy
+            if(_initial_memory.size() <= (uint64_t(_initial_memory_config.size.min) << IR::numBytesPerPageLog2))
+               _memory_image = createMemoryImage(_initial_memory);
+         }
       }
 
       ~wavm_instantiated_module() {
+         destroyMemoryImage(_memory_image);
          detail::the_wavm_live_modules.remove_live_module(_module_ref);
       }
 
       void apply(apply_context& context) override {
-         vector<Value> args = {Value(uint64_t(context.get_receiver())),
-	                            Value(uint64_t(context.get_action().account)),
+         const Value args[] = {Value(uint64_t(context.get_receiver())),
+                               Value(uint64_t(context.get_action().account)),
                                Value(uint64_t(context.get_action().name))};
 
-         call("apply", args, context);
+         call(_apply, args, context);
       }
 
    private:
-      void call(const string &entry_point, const vector <Value> &args, apply_context &context) {
+      template<size_t N>
+      void call(FunctionInstance* call, const Value (&args)[N], apply_context &context) {
          try {
-            FunctionInstance* call = asFunctionNullable(getInstanceExport(_instance,entry_point));
             if( !call )
                return;
 
-            EOS_ASSERT( getFunctionType(call)->parameters.size() == args.size(), wasm_exception, "" );
+            EOS_ASSERT( getFunctionType(call)->parameters.size() == N, wasm_exception, "" );
 
             //The memory instance is reused across all wavm_instantiated_modules, but for wasm instances
             // that didn't declare "memory", getDefaultMemory() won't see it
             MemoryInstance* default_mem = getDefaultMemory(_instance);
-            if(default_mem) {
+            if(default_mem && _memory_image) {
+               //remapping replaces the pages the previous call dirtied without touching them
+               resetMemory(default_mem, _initial_memory_config, _memory_image);
+            }
+            else if(default_mem) {
                //reset memory resizes the sandbox'ed memory to the module's init memory size and then
                // (effectively) memzeros it all
                resetMemory(default_mem, _initial_memory_config);
@@ -107,7 +296,7 @@ class wavm_instantiated_module : public wasm_instantiated_module_interface {
 
             resetGlobalInstances(_instance);
             runInstanceStartFunc(_instance);
-            Runtime::invokeFunction(call,args);
+            Runtime::invokeFunction(call,args,N);
          } catch( const wasm_exit& e ) {
          } catch( const Runtime::Exception& e ) {
              FC_THROW_EXCEPTION(wasm_execution_error,
@@ -123,11 +312,33 @@ class wavm_instantiated_module : public wasm_instantiated_module_interface {
       //_instance is deleted via WAVM's object garbage collection when wavm_rutime is deleted
       ModuleInstance*          _instance;
       detail::live_module_ref  _module_ref;
+      //the entry point is looked up once rather than by name on every action; the globals are still reset and the
+      //start function still run before each action, there is no pool of initialized instances
+      FunctionInstance*        _apply;
       MemoryType               _initial_memory_config;
+      MemoryImage*             _memory_image = nullptr;
 };
 
-wavm_runtime::wavm_runtime() {
+wavm_runtime::wavm_runtime(const wasm_interface_config& cfg) : wavm_runtime(cfg, cfg.wavm_opt_level) {
+}
+
+wavm_runtime::wavm_runtime(const wasm_interface_config& cfg, uint8_t opt_level) {
    static detail::wavm_runtime_initializer the_wavm_runtime_initializer;
+   EOS_ASSERT(opt_level <= uint8_t(OptimizationLevel::aggressive), wasm_exception,
+              "wavm optimization level ${l} is not between 0 and ${max}", ("l", opt_level)("max", uint8_t(OptimizationLevel::aggressive)));
+   this->opt_level = OptimizationLevel(opt_level);
+
+   if(!cfg.wavm_code_cache_dir.empty()) {
+      static std::mutex caches_mtx;
+      static std::map<std::string, std::weak_ptr<detail::wavm_code_cache>> caches;
+      std::lock_guard<std::mutex> g(caches_mtx);
+      auto& cache = caches[cfg.wavm_code_cache_dir.generic_string()];
+      code_cache = cache.lock();
+      if(!code_cache) {
+         code_cache = std::make_shared<detail::wavm_code_cache>(cfg.wavm_code_cache_dir, cfg.wavm_code_cache_size);
+         cache = code_cache;
+      }
+   }
 }
 
 wavm_runtime::~wavm_runtime() {
@@ -146,10 +357,24 @@ std::unique_ptr<wasm_instantiated_module_interface> wavm_runtime::instantiate_mo
 
    eosio::chain::webassembly::common::root_resolver resolver;
    LinkResult link_result = linkModule(*module, resolver);
-   ModuleInstance *instance = instantiateModule(*module, std::move(link_result.resolvedImports));
-   EOS_ASSERT(instance != nullptr, wasm_exception, "Fail to Instantiate WAVM Module");
+   std::string code_cache_key;
+   if(code_cache) {
+      //the code given here is already injected, so its hash covers the injection version as well as the contract
+      fc::sha256::encoder enc;
+      enc.write(getCodeGenTag().data(), getCodeGenTag().size());
+      enc.write((const char*)&opt_level, sizeof(opt_level));
+      enc.write(code_bytes, code_size);
+      code_cache_key = enc.result().str();
+   }
+   auto instance = detail::the_wavm_live_modules.instantiate([&]() {
+      return instantiateModule(*module, std::move(link_result.resolvedImports), code_cache.get(), code_cache_key, opt_level);
+   });
+
+   return std::make_unique<wavm_instantiated_module>(instance.first, instance.second, std::move(module), initial_memory);
+}
 
-   return std::make_unique<wavm_instantiated_module>(instance, std::move(module), initial_memory);
+void wavm_runtime::collect_garbage() {
+   detail::the_wavm_live_modules.collect_pending_garbage();
 }
 
 void wavm_runtime::immediately_exit_currently_running_module() {
@@ -94,6 +94,26 @@ namespace Platform
 	// baseVirtualAddress must be a multiple of the preferred page size.
 	PLATFORM_API void freeVirtualPages(U8* baseVirtualAddress,Uptr numPages);
 
+	// Replaces the specified virtual pages with newly committed zero pages that have the specified access.
+	// baseVirtualAddress must be a multiple of the preferred page size.
+	// Return true if successful, or false if physical memory has been exhausted.
+	PLATFORM_API bool resetVirtualPages(U8* baseVirtualAddress,Uptr numPages,MemoryAccess access);
+
+	// A page aligned copy of some data that can be mapped copy-on-write into virtual pages.
+	struct PageImage;
+
+	// Creates an image of the data, padded with zeros to a whole number of pages.
+	// Returns nullptr if the platform doesn't support page images or the image couldn't be created.
+	PLATFORM_API PageImage* createPageImage(const U8* data,Uptr numBytes);
+	PLATFORM_API void destroyPageImage(PageImage* image);
+	PLATFORM_API Uptr getPageImageNumPages(const PageImage* image);
+
+	// Replaces the virtual pages at baseVirtualAddress with a read-write, copy-on-write mapping of the image: the pages
+	// share the image's physical memory until they are written to.
+	// baseVirtualAddress must be a multiple of the preferred page size.
+	// Return true if successful.
+	PLATFORM_API bool mapPageImage(U8* baseVirtualAddress,const PageImage* image);
+
 	//
 	// Call stack and exceptions
 	//
@@ -123,6 +123,7 @@ namespace Runtime
 	// Invokes a FunctionInstance with the given parameters, and returns the result.
 	// Throws a Runtime::Exception if a trap occurs.
 	RUNTIME_API Result invokeFunction(FunctionInstance* function,const std::vector<Value>& parameters);
+	RUNTIME_API Result invokeFunction(FunctionInstance* function,const Value* parameters,Uptr numParameters);
 
 	// Returns the type of a FunctionInstance.
 	RUNTIME_API const IR::FunctionType* getFunctionType(FunctionInstance* function);
@@ -202,8 +203,34 @@ namespace Runtime
 		std::vector<GlobalInstance*> globals;
 	};
 
+	// Stores the machine code generated for modules, so that it can be loaded instead of being generated again.
+	struct ObjectCache
+	{
+		virtual ~ObjectCache() {}
+
+		// Returns the object stored for key, or an empty vector if there is none.
+		virtual std::vector<U8> getObject(const std::string& key) = 0;
+		virtual void putObject(const std::string& key,const std::vector<U8>& objectBytes) = 0;
+	};
+
+	// Identifies the code generator. Objects generated by a different one must not be loaded, so it should be part of object cache keys.
+	RUNTIME_API const std::string& getCodeGenTag();
+
+	// How much time the JIT spends optimizing a module: none generates code fastest, aggressive generates the fastest code.
+	enum class OptimizationLevel : U8
+	{
+		none,
+		basic,
+		aggressive
+	};
+
 	// Instantiates a module, bindings its imports to the specified objects. May throw InstantiationException.
-	RUNTIME_API ModuleInstance* instantiateModule(const IR::Module& module,ImportBindings&& imports);
+	// If objectCache is given, the machine code for the module is loaded from it or stored into it under objectCacheKey;
+	// the key should identify the optimization level as well as the code.
+	// May be called on a different thread than the one invoking functions, but not concurrently with itself or freeUnreferencedObjects.
+	RUNTIME_API ModuleInstance* instantiateModule(const IR::Module& module,ImportBindings&& imports,
+		ObjectCache* objectCache = nullptr,const std::string& objectCacheKey = std::string(),
+		OptimizationLevel optimizationLevel = OptimizationLevel::basic);
 
 	// Gets the default table/memory for a ModuleInstance.
 	RUNTIME_API MemoryInstance* getDefaultMemory(ModuleInstance* moduleInstance);
@@ -214,6 +241,18 @@ namespace Runtime
 	RUNTIME_API void resetGlobalInstances(ModuleInstance* moduleInstance);
 	RUNTIME_API void resetMemory(MemoryInstance* memory, IR::MemoryType& newMemoryType);
 
+	// A copy of a memory's initial contents that resetMemory can map copy-on-write instead of copying it.
+	struct MemoryImage;
+
+	// Returns nullptr if the platform doesn't support memory images.
+	RUNTIME_API MemoryImage* createMemoryImage(const std::vector<U8>& initialContents);
+	RUNTIME_API void destroyMemoryImage(MemoryImage* image);
+
+	// Resets the memory to newMemoryType's minimum size with the image's contents followed by zeros. The image must fit
+	// in the minimum size. Pages the previous call wrote to are discarded rather than cleared, so the cost of a reset
+	// doesn't depend on the size of the memory.
+	RUNTIME_API void resetMemory(MemoryInstance* memory, IR::MemoryType& newMemoryType, const MemoryImage* image);
+
 	// Gets an object exported by a ModuleInstance by name.
 	RUNTIME_API ObjectInstance* getInstanceExport(ModuleInstance* moduleInstance,const std::string& name);
 }
@@ -17,6 +17,12 @@
 #include <string>
 
 #include <sys/time.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+
+#include <map>
+#include <mutex>
+#include <vector>
 
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
@@ -101,6 +107,121 @@ namespace Platform
 		if(mprotect(baseVirtualAddress,numBytes,PROT_NONE)) { Errors::fatal("mprotect failed"); }
 	}
 
+	bool resetVirtualPages(U8* baseVirtualAddress,Uptr numPages,MemoryAccess access)
+	{
+		errorUnless(isPageAligned(baseVirtualAddress));
+		if(!numPages) { return true; }
+		return mmap(baseVirtualAddress,numPages << getPageSizeLog2(),memoryAccessAsPOSIXFlag(access),MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,-1,0) != MAP_FAILED;
+	}
+
+	// Page images are ranges of a single anonymous file, so that their number isn't limited by the number of open files.
+	// Ranges of destroyed images are reused by later images of the same or a smaller size.
+	struct PageImage
+	{
+		Uptr firstPage;
+		Uptr numPages;
+	};
+
+	struct PageImageFile
+	{
+		std::mutex mutex;
+		int fd = -1;
+		Uptr numPages = 0;
+		std::multimap<Uptr,Uptr> freeRanges; // numPages -> firstPage
+
+		static PageImageFile& get()
+		{
+			static PageImageFile file;
+			return file;
+		}
+
+		bool open()
+		{
+			if(fd >= 0) { return true; }
+			#if defined(__linux__) && defined(SYS_memfd_create)
+				fd = (int)syscall(SYS_memfd_create,"wavm-page-images",0);
+			#endif
+			if(fd < 0)
+			{
+				char path[] = "/tmp/wavm-page-images-XXXXXX";
+				fd = mkstemp(path);
+				if(fd >= 0) { unlink(path); }
+			}
+			return fd >= 0;
+		}
+	};
+
+	PageImage* createPageImage(const U8* data,Uptr numBytes)
+	{
+		const Uptr pageSize = Uptr(1) << getPageSizeLog2();
+		const Uptr numPages = (numBytes + pageSize - 1) >> getPageSizeLog2();
+
+		PageImageFile& file = PageImageFile::get();
+		PageImage* image = new PageImage {0,numPages};
+		if(numPages)
+		{
+			std::lock_guard<std::mutex> lock(file.mutex);
+			if(!file.open()) { delete image; return nullptr; }
+
+			auto freeIt = file.freeRanges.lower_bound(numPages);
+			if(freeIt != file.freeRanges.end())
+			{
+				image->firstPage = freeIt->second;
+				if(freeIt->first > numPages) { file.freeRanges.emplace(freeIt->first - numPages,freeIt->second + numPages); }
+				file.freeRanges.erase(freeIt);
+			}
+			else
+			{
+				if(ftruncate(file.fd,off_t((file.numPages + numPages) << getPageSizeLog2()))) { delete image; return nullptr; }
+				image->firstPage = file.numPages;
+				file.numPages += numPages;
+			}
+		}
+
+		// Write the data followed by zeros up to the end of the last page, which may hold data of a destroyed image.
+		const off_t offset = off_t(image->firstPage << getPageSizeLog2());
+		const Uptr numPaddedBytes = numPages << getPageSizeLog2();
+		Uptr numWrittenBytes = 0;
+		while(numWrittenBytes < numBytes)
+		{
+			const ssize_t result = pwrite(file.fd,data + numWrittenBytes,numBytes - numWrittenBytes,offset + numWrittenBytes);
+			if(result <= 0) { destroyPageImage(image); return nullptr; }
+			numWrittenBytes += Uptr(result);
+		}
+		if(numPaddedBytes > numBytes)
+		{
+			std::vector<U8> zeros(numPaddedBytes - numBytes,0);
+			if(pwrite(file.fd,zeros.data(),zeros.size(),offset + numBytes) != ssize_t(zeros.size())) { destroyPageImage(image); return nullptr; }
+		}
+		return image;
+	}
+
+	void destroyPageImage(PageImage* image)
+	{
+		if(!image) { return; }
+		if(image->numPages)
+		{
+			PageImageFile& file = PageImageFile::get();
+			std::lock_guard<std::mutex> lock(file.mutex);
+			#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+				// Release the memory of the range until it is reused.
+				fallocate(file.fd,FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,off_t(image->firstPage << getPageSizeLog2()),off_t(image->numPages << getPageSizeLog2()));
+			#endif
+			file.freeRanges.emplace(image->numPages,image->firstPage);
+		}
+		delete image;
+	}
+
+	Uptr getPageImageNumPages(const PageImage* image) { return image->numPages; }
+
+	bool mapPageImage(U8* baseVirtualAddress,const PageImage* image)
+	{
+		errorUnless(isPageAligned(baseVirtualAddress));
+		if(!image->numPages) { return true; }
+		return mmap(baseVirtualAddress,image->numPages << getPageSizeLog2(),PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_FIXED,
+			PageImageFile::get().fd,off_t(image->firstPage << getPageSizeLog2())) != MAP_FAILED;
+	}
+
 	void freeVirtualPages(U8* baseVirtualAddress,Uptr numPages)
 	{
 		errorUnless(isPageAligned(baseVirtualAddress));
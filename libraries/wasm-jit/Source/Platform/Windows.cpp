@@ -78,6 +78,18 @@ namespace Platform
 		if(baseVirtualAddress && !result) { Errors::fatal("VirtualFree(MEM_DECOMMIT) failed"); }
 	}
 
+	bool resetVirtualPages(U8* baseVirtualAddress,Uptr numPages,MemoryAccess access)
+	{
+		decommitVirtualPages(baseVirtualAddress,numPages);
+		return access == MemoryAccess::None || commitVirtualPages(baseVirtualAddress,numPages,access);
+	}
+
+	// Copy-on-write views of a section can't replace part of a reserved region, so page images aren't supported.
+	PageImage* createPageImage(const U8* data,Uptr numBytes) { return nullptr; }
+	void destroyPageImage(PageImage* image) {}
+	Uptr getPageImageNumPages(const PageImage* image) { return 0; }
+	bool mapPageImage(U8* baseVirtualAddress,const PageImage* image) { return false; }
+
 	void freeVirtualPages(U8* baseVirtualAddress,Uptr numPages)
 	{
 		errorUnless(isPageAligned(baseVirtualAddress));
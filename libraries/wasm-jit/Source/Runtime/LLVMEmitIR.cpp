@@ -25,8 +25,10 @@ namespace LLVMJIT
 		std::vector<llvm::Constant*> globalPointers;
 		llvm::Constant* defaultTablePointer;
 		llvm::Constant* defaultTableMaxElementIndex;
+		llvm::Constant* defaultTableObject;
 		llvm::Constant* defaultMemoryBase;
 		llvm::Constant* defaultMemoryEndOffset;
+		llvm::Constant* defaultMemoryObject;
 
 		llvm::MDNode* likelyFalseBranchWeights;
 		llvm::MDNode* likelyTrueBranchWeights;
@@ -43,6 +45,17 @@ namespace LLVMJIT
 
 		}
 		llvm::Module* emit();
+
+		// Declares an external symbol of the given type, returning a pointer to it.
+		llvm::Constant* emitSymbolPointer(const std::string& name,llvm::Type* type)
+		{
+			return llvmModule->getOrInsertGlobal(name,type);
+		}
+		// Declares an external symbol, returning its address as an i64 for passing to the runtime intrinsics.
+		llvm::Constant* emitSymbolAddress(const std::string& name)
+		{
+			return llvm::ConstantExpr::getPtrToInt(emitSymbolPointer(name,llvmI8Type),llvmI64Type);
+		}
 	};
 
 	// The context used by functions involved in JITing a single AST function.
@@ -287,7 +300,7 @@ namespace LLVMJIT
 			WAVM_ASSERT_THROW(intrinsicObject);
 			FunctionInstance* intrinsicFunction = asFunction(intrinsicObject);
 			WAVM_ASSERT_THROW(intrinsicFunction->type == intrinsicType);
-			auto intrinsicFunctionPointer = emitLiteralPointer(intrinsicFunction->nativeFunction,asLLVMType(intrinsicType)->getPointerTo());
+			auto intrinsicFunctionPointer = moduleContext.llvmModule->getOrInsertFunction(getIntrinsicSymbolName(intrinsicName,intrinsicType),asLLVMType(intrinsicType));
 			return irBuilder.CreateCall(intrinsicFunctionPointer,llvm::ArrayRef<llvm::Value*>(args.begin(),args.end()));
 		}
 
@@ -668,7 +681,7 @@ namespace LLVMJIT
 			// Load the type for this table entry.
 			auto functionTypePointerPointer = irBuilder.CreateInBoundsGEP(moduleContext.defaultTablePointer,{functionIndexZExt,emitLiteral((U32)0)});
 			auto functionTypePointer = irBuilder.CreateLoad(functionTypePointerPointer);
-			auto llvmCalleeType = emitLiteralPointer(calleeType,llvmI8PtrType);
+			auto llvmCalleeType = moduleContext.emitSymbolPointer(getFunctionTypeSymbolName(imm.type.index),llvmI8Type);
 			
 			// If the function type doesn't match, trap.
 			emitConditionalTrapIntrinsic(
@@ -677,7 +690,7 @@ namespace LLVMJIT
 				FunctionType::get(ResultType::none,{ValueType::i32,ValueType::i64,ValueType::i64}),
 				{	tableElementIndex,
 					irBuilder.CreatePtrToInt(llvmCalleeType,llvmI64Type),
-					emitLiteral(reinterpret_cast<U64>(moduleContext.moduleInstance->defaultTable))	}
+					moduleContext.defaultTableObject	}
 				);
 
 			// Call the function loaded from the table.
@@ -731,7 +744,7 @@ namespace LLVMJIT
 		void grow_memory(MemoryImm)
 		{
 			auto deltaNumPages = pop();
-			auto defaultMemoryObjectAsI64 = emitLiteral(reinterpret_cast<U64>(moduleContext.moduleInstance->defaultMemory));
+			auto defaultMemoryObjectAsI64 = moduleContext.defaultMemoryObject;
 			auto previousNumPages = emitRuntimeIntrinsic(
 				"wavmIntrinsics.growMemory",
 				FunctionType::get(ResultType::i32,{ValueType::i32,ValueType::i64}),
@@ -740,7 +753,7 @@ namespace LLVMJIT
 		}
 		void current_memory(MemoryImm)
 		{
-			auto defaultMemoryObjectAsI64 = emitLiteral(reinterpret_cast<U64>(moduleContext.moduleInstance->defaultMemory));
+			auto defaultMemoryObjectAsI64 = moduleContext.defaultMemoryObject;
 			auto currentNumPages = emitRuntimeIntrinsic(
 				"wavmIntrinsics.currentMemory",
 				FunctionType::get(ResultType::i32,{ValueType::i64}),
@@ -1215,7 +1228,7 @@ namespace LLVMJIT
 		{
 			auto numWaiters = pop();
 			auto address = pop();
-			auto defaultMemoryObjectAsI64 = emitLiteral(reinterpret_cast<U64>(moduleContext.moduleInstance->defaultMemory));
+			auto defaultMemoryObjectAsI64 = moduleContext.defaultMemoryObject;
 			push(emitRuntimeIntrinsic(
 				"wavmIntrinsics.wake",
 				FunctionType::get(ResultType::i32,{ValueType::i32,ValueType::i32,ValueType::i64}),
@@ -1226,7 +1239,7 @@ namespace LLVMJIT
 			auto timeout = pop();
 			auto expectedValue = pop();
 			auto address = pop();
-			auto defaultMemoryObjectAsI64 = emitLiteral(reinterpret_cast<U64>(moduleContext.moduleInstance->defaultMemory));
+			auto defaultMemoryObjectAsI64 = moduleContext.defaultMemoryObject;
 			push(emitRuntimeIntrinsic(
 				"wavmIntrinsics.wait",
 				FunctionType::get(ResultType::i32,{ValueType::i32,ValueType::i32,ValueType::f64,ValueType::i64}),
@@ -1237,7 +1250,7 @@ namespace LLVMJIT
 			auto timeout = pop();
 			auto expectedValue = pop();
 			auto address = pop();
-			auto defaultMemoryObjectAsI64 = emitLiteral(reinterpret_cast<U64>(moduleContext.moduleInstance->defaultMemory));
+			auto defaultMemoryObjectAsI64 = moduleContext.defaultMemoryObject;
 			push(emitRuntimeIntrinsic(
 				"wavmIntrinsics.wait",
 				FunctionType::get(ResultType::i32,{ValueType::i32,ValueType::i64,ValueType::f64,ValueType::i64}),
@@ -1250,7 +1263,7 @@ namespace LLVMJIT
 			auto errorFunctionIndex = pop();
 			auto argument = pop();
 			auto functionIndex = pop();
-			auto defaultTableAsI64 = emitLiteral(reinterpret_cast<U64>(moduleContext.moduleInstance->defaultTable));
+			auto defaultTableAsI64 = moduleContext.defaultTableObject;
 			emitRuntimeIntrinsic(
 				"wavmIntrinsics.launchThread",
 				FunctionType::get(ResultType::none,{ValueType::i32,ValueType::i32,ValueType::i32,ValueType::i64}),
@@ -1540,14 +1553,15 @@ namespace LLVMJIT
 	{
 		Timing::Timer emitTimer;
 
-		// Create literals for the default memory base and mask.
+		// Create symbols for the default memory base and object, and a literal for its end offset.
 		if(moduleInstance->defaultMemory)
 		{
-			defaultMemoryBase = emitLiteralPointer(moduleInstance->defaultMemory->baseAddress,llvmI8PtrType);
+			defaultMemoryBase = emitSymbolPointer(defaultMemoryBaseSymbolName,llvmI8Type);
+			defaultMemoryObject = emitSymbolAddress(defaultMemorySymbolName);
 			const Uptr defaultMemoryEndOffsetValue = Uptr(moduleInstance->defaultMemory->endOffset);
 			defaultMemoryEndOffset = emitLiteral(defaultMemoryEndOffsetValue);
 		}
-		else { defaultMemoryBase = defaultMemoryEndOffset = nullptr; }
+		else { defaultMemoryBase = defaultMemoryEndOffset = defaultMemoryObject = nullptr; }
 
 		// Set up the LLVM values used to access the global table.
 		if(moduleInstance->defaultTable)
@@ -1556,24 +1570,25 @@ namespace LLVMJIT
 				llvmI8PtrType,
 				llvmI8PtrType
 				});
-			defaultTablePointer = emitLiteralPointer(moduleInstance->defaultTable->baseAddress,tableElementType->getPointerTo());
+			defaultTablePointer = emitSymbolPointer(defaultTableBaseSymbolName,tableElementType);
 			defaultTableMaxElementIndex = emitLiteral(((Uptr)moduleInstance->defaultTable->endOffset)/sizeof(TableInstance::FunctionElement));
+			defaultTableObject = emitSymbolAddress(defaultTableSymbolName);
 		}
 		else
 		{
-			defaultTablePointer = defaultTableMaxElementIndex = nullptr;
+			defaultTablePointer = defaultTableMaxElementIndex = defaultTableObject = nullptr;
 		}
 
-		// Create LLVM pointer constants for the module's imported functions.
+		// Create LLVM symbols for the module's imported functions.
 		for(Uptr functionIndex = 0;functionIndex < module.functions.imports.size();++functionIndex)
 		{
 			const FunctionInstance* functionInstance = moduleInstance->functions[functionIndex];
-			importedFunctionPointers.push_back(emitLiteralPointer(functionInstance->nativeFunction,asLLVMType(functionInstance->type)->getPointerTo()));
+			importedFunctionPointers.push_back(llvmModule->getOrInsertFunction(getImportedFunctionSymbolName(functionIndex),asLLVMType(functionInstance->type)));
 		}
 
-		// Create LLVM pointer constants for the module's globals.
-		for(auto global : moduleInstance->globals)
-		{ globalPointers.push_back(emitLiteralPointer(&global->value,asLLVMType(global->type.valueType)->getPointerTo())); }
+		// Create LLVM symbols for the module's globals.
+		for(Uptr globalIndex = 0;globalIndex < moduleInstance->globals.size();++globalIndex)
+		{ globalPointers.push_back(emitSymbolPointer(getGlobalSymbolName(globalIndex),asLLVMType(moduleInstance->globals[globalIndex]->type.valueType))); }
 		
 		// Create the LLVM functions.
 		functionDefs.resize(module.functions.defs.size());
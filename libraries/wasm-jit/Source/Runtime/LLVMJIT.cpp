@@ -51,14 +51,26 @@ namespace LLVMJIT
 	#endif
 
 	llvm::Constant* typedZeroConstants[(Uptr)ValueType::num];
+
+	// Identifies the code generator, see Runtime::getCodeGenTag. Bump codeGenVersion when the emitted code changes.
+	static const char codeGenVersion[] = "1";
+	std::string codeGenTag;
 	
 	// A map from address to loaded JIT symbols.
 	Platform::Mutex* addressToSymbolMapMutex = Platform::createMutex();
 	std::map<Uptr,struct JITSymbol*> addressToSymbolMap;
 
 	// A map from function types to function indices in the invoke thunk unit.
+	Platform::Mutex* invokeThunkMutex = Platform::createMutex();
 	std::map<const FunctionType*,struct JITSymbol*> invokeThunkTypeToSymbolMap;
 
+	// Serializes the use of the LLVM context, so that modules may be compiled on a different thread than the one
+	// invoking functions.
+	Platform::Mutex* llvmMutex = Platform::createMutex();
+
+	// Returns the invoke thunk for a function type, compiling it if needed; llvmMutex must be held.
+	static InvokeFunctionPointer getInvokeThunkLocked(const FunctionType* functionType);
+
 	// Information about a JIT symbol, used to map instruction pointers to descriptive names.
 	struct JITSymbol
 	{
@@ -209,6 +221,28 @@ namespace LLVMJIT
 		void operator=(const UnitMemoryManager&) = delete;
 	};
 
+	// Used to override LLVM's default behavior of looking up unresolved symbols in DLL exports.
+	struct NullResolver : llvm::JITSymbolResolver
+	{
+		static NullResolver singleton;
+		virtual llvm::JITSymbol findSymbol(const std::string& name) override;
+		virtual llvm::JITSymbol findSymbolInLogicalDylib(const std::string& name) override;
+	};
+
+	// Copies the object generated for a module, so that it can be stored in a Runtime::ObjectCache.
+	struct ObjectCapture : llvm::ObjectCache
+	{
+		std::vector<U8>& objectBytes;
+
+		ObjectCapture(std::vector<U8>& inObjectBytes): objectBytes(inObjectBytes) {}
+
+		void notifyObjectCompiled(const llvm::Module* llvmModule,llvm::MemoryBufferRef object) override
+		{
+			objectBytes.assign((const U8*)object.getBufferStart(),(const U8*)object.getBufferEnd());
+		}
+		std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module* llvmModule) override { return nullptr; }
+	};
+
 	// A unit of JIT compilation.
 	// Encapsulates the LLVM JIT compilation pipeline but allows subclasses to define how the resulting code is used.
 	struct JITUnit
@@ -232,10 +266,16 @@ namespace LLVMJIT
 			#endif
 		}
 
-		void compile(llvm::Module* llvmModule);
+		// Compiles and loads the module. If outObjectBytes is given, the generated object is copied to it.
+		void compile(llvm::Module* llvmModule,std::vector<U8>* outObjectBytes = nullptr,OptimizationLevel optimizationLevel = OptimizationLevel::basic);
+		// Loads an object generated by compile, returns false if it is not a valid object file.
+		bool load(const std::vector<U8>& objectBytes);
 
 		virtual void notifySymbolLoaded(const char* name,Uptr baseAddress,Uptr numBytes,std::map<U32,U32>&& offsetToOpIndexMap) = 0;
 
+		// Resolves the external symbols of the generated code.
+		virtual llvm::JITSymbolResolver* getResolver() { return &NullResolver::singleton; }
+
 	private:
 		
 		// Functor that receives notifications when an object produced by the JIT is loaded.
@@ -280,18 +320,34 @@ namespace LLVMJIT
 		#endif
 	};
 
+	// Resolves the symbols the code generated for a module instance uses to refer to its objects, see LLVMEmitIR.cpp.
+	struct ModuleInstanceResolver : llvm::JITSymbolResolver
+	{
+		ModuleInstance* moduleInstance;
+		std::vector<const FunctionType*> types;
+
+		ModuleInstanceResolver(ModuleInstance* inModuleInstance,const IR::Module& module)
+		: moduleInstance(inModuleInstance), types(module.types) {}
+
+		virtual llvm::JITSymbol findSymbol(const std::string& name) override;
+		virtual llvm::JITSymbol findSymbolInLogicalDylib(const std::string& name) override { return llvm::JITSymbol(nullptr); }
+	};
+
 	// The JIT compilation unit for a WebAssembly module instance.
 	struct JITModule : JITUnit, JITModuleBase
 	{
 		ModuleInstance* moduleInstance;
+		ModuleInstanceResolver resolver;
 
 		std::vector<JITSymbol*> functionDefSymbols;
 
-		JITModule(ModuleInstance* inModuleInstance): moduleInstance(inModuleInstance) {}
+		JITModule(ModuleInstance* inModuleInstance,const IR::Module& module): moduleInstance(inModuleInstance), resolver(inModuleInstance,module) {}
 		~JITModule() override
 		{
 		}
 
+		llvm::JITSymbolResolver* getResolver() override { return &resolver; }
+
 		void notifySymbolLoaded(const char* name,Uptr baseAddress,Uptr numBytes,std::map<U32,U32>&& offsetToOpIndexMap) override
 		{
 			// Save the address range this function was loaded at for future address->symbol lookups.
@@ -326,14 +382,6 @@ namespace LLVMJIT
 		}
 	};
 	
-	// Used to override LLVM's default behavior of looking up unresolved symbols in DLL exports.
-	struct NullResolver : llvm::JITSymbolResolver
-	{
-		static NullResolver singleton;
-		virtual llvm::JITSymbol findSymbol(const std::string& name) override;
-		virtual llvm::JITSymbol findSymbolInLogicalDylib(const std::string& name) override;
-	};
-	
 	static std::map<std::string,const char*> runtimeSymbolMap =
 	{
 		#ifdef _WIN32
@@ -374,6 +422,64 @@ namespace LLVMJIT
 	}
 	llvm::JITSymbol NullResolver::findSymbolInLogicalDylib(const std::string& name) { return llvm::JITSymbol(nullptr); }
 
+	const char* const defaultMemoryBaseSymbolName = "wavmDefaultMemoryBase";
+	const char* const defaultMemorySymbolName = "wavmDefaultMemory";
+	const char* const defaultTableBaseSymbolName = "wavmDefaultTableBase";
+	const char* const defaultTableSymbolName = "wavmDefaultTable";
+	static const char importedFunctionSymbolPrefix[] = "wavmImport";
+	static const char globalSymbolPrefix[] = "wavmGlobal";
+	static const char functionTypeSymbolPrefix[] = "wavmType";
+	static const char intrinsicSymbolPrefix[] = "wavmIntrinsic:";
+
+	std::string getImportedFunctionSymbolName(Uptr functionImportIndex) { return importedFunctionSymbolPrefix + std::to_string(functionImportIndex); }
+	std::string getGlobalSymbolName(Uptr globalIndex) { return globalSymbolPrefix + std::to_string(globalIndex); }
+	std::string getFunctionTypeSymbolName(Uptr typeIndex) { return functionTypeSymbolPrefix + std::to_string(typeIndex); }
+	std::string getIntrinsicSymbolName(const char* intrinsicName,const FunctionType* intrinsicType)
+	{
+		return intrinsicSymbolPrefix + Intrinsics::getDecoratedName(intrinsicName,intrinsicType);
+	}
+
+	// Parses the index following prefix in a symbol name, returns false if the name doesn't start with prefix.
+	static bool getSymbolIndex(const std::string& name,const char* prefix,Uptr& outIndex)
+	{
+		const Uptr numPrefixChars = strlen(prefix);
+		if(name.compare(0,numPrefixChars,prefix)) { return false; }
+		char* numberEnd = nullptr;
+		outIndex = Uptr(std::strtoull(name.c_str() + numPrefixChars,&numberEnd,10));
+		return numberEnd != name.c_str() + numPrefixChars && *numberEnd == 0;
+	}
+
+	llvm::JITSymbol ModuleInstanceResolver::findSymbol(const std::string& name)
+	{
+		const void* address = nullptr;
+		Uptr index = 0;
+		if(name == defaultMemoryBaseSymbolName && moduleInstance->defaultMemory) { address = moduleInstance->defaultMemory->baseAddress; }
+		else if(name == defaultMemorySymbolName) { address = moduleInstance->defaultMemory; }
+		else if(name == defaultTableBaseSymbolName && moduleInstance->defaultTable) { address = moduleInstance->defaultTable->baseAddress; }
+		else if(name == defaultTableSymbolName) { address = moduleInstance->defaultTable; }
+		else if(getSymbolIndex(name,importedFunctionSymbolPrefix,index))
+		{
+			if(index < moduleInstance->functions.size()) { address = moduleInstance->functions[index]->nativeFunction; }
+		}
+		else if(getSymbolIndex(name,globalSymbolPrefix,index))
+		{
+			if(index < moduleInstance->globals.size()) { address = &moduleInstance->globals[index]->value; }
+		}
+		else if(getSymbolIndex(name,functionTypeSymbolPrefix,index))
+		{
+			if(index < types.size()) { address = types[index]; }
+		}
+		else if(!name.compare(0,sizeof(intrinsicSymbolPrefix) - 1,intrinsicSymbolPrefix))
+		{
+			FunctionInstance* intrinsicFunction = Intrinsics::findFunctionByDecoratedName(name.substr(sizeof(intrinsicSymbolPrefix) - 1));
+			if(intrinsicFunction) { address = intrinsicFunction->nativeFunction; }
+		}
+		else { return NullResolver::singleton.findSymbol(name); }
+
+		if(!address) { Errors::fatalf("LLVM generated code references unresolvable symbol: %s\n",name.c_str()); }
+		return llvm::JITSymbol(reinterpret_cast<Uptr>(address),llvm::JITSymbolFlags::None);
+	}
+
 	void JITUnit::NotifyLoadedFunctor::operator()(
 		const llvm::orc::ObjectLinkingLayerBase::ObjSetHandleT& objectSetHandle,
 		const std::vector<std::unique_ptr<llvm::object::OwningBinary<llvm::object::ObjectFile>>>& objectSet,
@@ -528,7 +634,7 @@ namespace LLVMJIT
 		Log::printf(Log::Category::debug,"Dumped LLVM module to: %s\n",augmentedFilename.c_str());
 	}
 
-	void JITUnit::compile(llvm::Module* llvmModule)
+	void JITUnit::compile(llvm::Module* llvmModule,std::vector<U8>* outObjectBytes,OptimizationLevel optimizationLevel)
 	{
 		// Get a target machine object for this host, and set the module to use its data layout.
 		llvmModule->setDataLayout(targetMachine->createDataLayout());
@@ -549,10 +655,25 @@ namespace LLVMJIT
 
 		auto fpm = new llvm::legacy::FunctionPassManager(llvmModule);
 		fpm->add(llvm::createPromoteMemoryToRegisterPass());
-		fpm->add(llvm::createInstructionCombiningPass());
-		fpm->add(llvm::createCFGSimplificationPass());
-		fpm->add(llvm::createJumpThreadingPass());
-		fpm->add(llvm::createConstantPropagationPass());
+		if(optimizationLevel != OptimizationLevel::none)
+		{
+			fpm->add(llvm::createInstructionCombiningPass());
+			fpm->add(llvm::createCFGSimplificationPass());
+			fpm->add(llvm::createJumpThreadingPass());
+			fpm->add(llvm::createConstantPropagationPass());
+		}
+		if(optimizationLevel == OptimizationLevel::aggressive)
+		{
+			// Redundancy elimination and loop invariant code motion, then another round of cleanup.
+			fpm->add(llvm::createEarlyCSEPass());
+			fpm->add(llvm::createReassociatePass());
+			fpm->add(llvm::createGVNPass());
+			fpm->add(llvm::createLICMPass());
+			fpm->add(llvm::createDeadStoreEliminationPass());
+			fpm->add(llvm::createAggressiveDCEPass());
+			fpm->add(llvm::createInstructionCombiningPass());
+			fpm->add(llvm::createCFGSimplificationPass());
+		}
 		fpm->doInitialization();
 
 		for(auto functionIt = llvmModule->begin();functionIt != llvmModule->end();++functionIt)
@@ -566,13 +687,27 @@ namespace LLVMJIT
 
 		if(DUMP_OPTIMIZED_MODULE) { printModule(llvmModule,"llvmOptimizedDump"); }
 
-		// Pass the module to the JIT compiler.
+		// Pass the module to the JIT compiler. The target machine is shared, but only used with llvmMutex locked.
+		switch(optimizationLevel)
+		{
+		case OptimizationLevel::none: targetMachine->setOptLevel(llvm::CodeGenOpt::None); break;
+		case OptimizationLevel::basic: targetMachine->setOptLevel(llvm::CodeGenOpt::Default); break;
+		case OptimizationLevel::aggressive: targetMachine->setOptLevel(llvm::CodeGenOpt::Aggressive); break;
+		default: Errors::unreachable();
+		};
 		Timing::Timer machineCodeTimer;
+		std::unique_ptr<ObjectCapture> objectCapture;
+		if(outObjectBytes)
+		{
+			objectCapture = llvm::make_unique<ObjectCapture>(*outObjectBytes);
+			compileLayer->setObjectCache(objectCapture.get());
+		}
 		handle = compileLayer->addModuleSet(
 			std::vector<llvm::Module*>{llvmModule},
 			&memoryManager,
-			&NullResolver::singleton);
+			getResolver());
 		handleIsValid = true;
+		compileLayer->setObjectCache(nullptr);
 		compileLayer->emitAndFinalize(handle);
 
 		if(shouldLogMetrics)
@@ -583,17 +718,63 @@ namespace LLVMJIT
 		delete llvmModule;
 	}
 
-	void instantiateModule(const IR::Module& module,ModuleInstance* moduleInstance)
+	bool JITUnit::load(const std::vector<U8>& objectBytes)
 	{
-		// Emit LLVM IR for the module.
-		auto llvmModule = emitModule(module,moduleInstance);
+		auto buffer = llvm::MemoryBuffer::getMemBufferCopy(llvm::StringRef((const char*)objectBytes.data(),objectBytes.size()));
+		auto object = llvm::object::ObjectFile::createObjectFile(buffer->getMemBufferRef());
+		if(!object)
+		{
+			llvm::consumeError(object.takeError());
+			return false;
+		}
+
+		std::vector<std::unique_ptr<llvm::object::OwningBinary<llvm::object::ObjectFile>>> objectSet;
+		objectSet.push_back(llvm::make_unique<llvm::object::OwningBinary<llvm::object::ObjectFile>>(std::move(*object),std::move(buffer)));
+		handle = objectLayer->addObjectSet(std::move(objectSet),&memoryManager,getResolver());
+		handleIsValid = true;
+		objectLayer->emitAndFinalize(handle);
+		return true;
+	}
+
+	void instantiateModule(const IR::Module& module,ModuleInstance* moduleInstance,ObjectCache* objectCache,const std::string& objectCacheKey,
+		OptimizationLevel optimizationLevel)
+	{
+		Platform::Lock llvmLock(llvmMutex);
 
 		// Construct the JIT compilation pipeline for this module.
-		auto jitModule = new JITModule(moduleInstance);
+		auto jitModule = new JITModule(moduleInstance,module);
 		moduleInstance->jitModule = jitModule;
 
-		// Compile the module.
-		jitModule->compile(llvmModule);
+		// Load the machine code generated for the module earlier, it only refers to the instance through symbols.
+		bool loaded = false;
+		if(objectCache)
+		{
+			std::vector<U8> objectBytes = objectCache->getObject(objectCacheKey);
+			loaded = objectBytes.size() && jitModule->load(objectBytes);
+		}
+
+		if(!loaded)
+		{
+			// Emit LLVM IR for the module.
+			auto llvmModule = emitModule(module,moduleInstance);
+
+			// Compile the module.
+			if(objectCache)
+			{
+				std::vector<U8> objectBytes;
+				jitModule->compile(llvmModule,&objectBytes,optimizationLevel);
+				if(objectBytes.size()) { objectCache->putObject(objectCacheKey,objectBytes); }
+			}
+			else { jitModule->compile(llvmModule,nullptr,optimizationLevel); }
+		}
+
+		// Compile the invoke thunks of the functions the module is entered through while the LLVM context is held, so
+		// that the thread invoking them does not wait for the context behind the next module's compilation.
+		for(const Export& exportIt : module.exports)
+		{
+			if(exportIt.kind == ObjectKind::function) { getInvokeThunkLocked(moduleInstance->functions[exportIt.index]->type); }
+		}
+		if(module.startFunctionIndex != UINTPTR_MAX) { getInvokeThunkLocked(moduleInstance->functions[module.startFunctionIndex]->type); }
 	}
 
 	std::string getExternalFunctionName(ModuleInstance* moduleInstance,Uptr functionDefIndex)
@@ -657,11 +838,27 @@ namespace LLVMJIT
 		return true;
 	}
 
-	InvokeFunctionPointer getInvokeThunk(const FunctionType* functionType)
+	static InvokeFunctionPointer findInvokeThunk(const FunctionType* functionType)
 	{
-		// Reuse cached invoke thunks for the same function type.
+		Platform::Lock invokeThunkLock(invokeThunkMutex);
 		auto mapIt = invokeThunkTypeToSymbolMap.find(functionType);
 		if(mapIt != invokeThunkTypeToSymbolMap.end()) { return reinterpret_cast<InvokeFunctionPointer>(mapIt->second->baseAddress); }
+		return nullptr;
+	}
+
+	InvokeFunctionPointer getInvokeThunk(const FunctionType* functionType)
+	{
+		// Reuse cached invoke thunks for the same function type.
+		if(auto invokeThunk = findInvokeThunk(functionType)) { return invokeThunk; }
+
+		Platform::Lock llvmLock(llvmMutex);
+		return getInvokeThunkLocked(functionType);
+	}
+
+	static InvokeFunctionPointer getInvokeThunkLocked(const FunctionType* functionType)
+	{
+		// Check again with the LLVM context held, another thread may have compiled the thunk meanwhile.
+		if(auto invokeThunk = findInvokeThunk(functionType)) { return invokeThunk; }
 
 		auto llvmModule = new llvm::Module("",context);
 		auto llvmFunctionType = llvm::FunctionType::get(
@@ -710,7 +907,10 @@ namespace LLVMJIT
 		jitUnit->compile(llvmModule);
 
 		WAVM_ASSERT_THROW(jitUnit->symbol);
-		invokeThunkTypeToSymbolMap[functionType] = jitUnit->symbol;
+		{
+			Platform::Lock invokeThunkLock(invokeThunkMutex);
+			invokeThunkTypeToSymbolMap[functionType] = jitUnit->symbol;
+		}
 
 		{
 			Platform::Lock addressToSymbolMapLock(addressToSymbolMapMutex);
@@ -744,6 +944,9 @@ namespace LLVMJIT
 			#endif
 			);
 
+		codeGenTag = std::string("wavm") + codeGenVersion + "-llvm" LLVM_VERSION_STRING "-" + targetTriple
+			+ "-" + targetMachine->getTargetCPU().str() + "-" + targetMachine->getTargetFeatureString().str();
+
 		llvmI8Type = llvm::Type::getInt8Ty(context);
 		llvmI16Type = llvm::Type::getInt16Ty(context);
 		llvmI32Type = llvm::Type::getInt32Ty(context);
@@ -785,3 +988,8 @@ namespace LLVMJIT
 		#endif
 	}
 }
+
+namespace Runtime
+{
+	const std::string& getCodeGenTag() { return LLVMJIT::codeGenTag; }
+}
@@ -24,7 +24,9 @@
 #endif
 
 #include "llvm/Analysis/Passes.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
 #include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
 #include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
@@ -47,9 +49,12 @@
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/Host.h"
 #include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/IR/DIBuilder.h"
 #include <cctype>
+#include <cstdlib>
+#include <cstring>
 #include <string>
 #include <vector>
 
@@ -123,6 +128,18 @@ namespace LLVMJIT
 	std::string getExternalFunctionName(ModuleInstance* moduleInstance,Uptr functionDefIndex);
 	bool getFunctionIndexFromExternalName(const char* externalName,Uptr& outFunctionDefIndex);
 
+	// Names of the external symbols the generated code uses to refer to the objects of its module instance and to
+	// the runtime intrinsics. They are resolved when the object is loaded rather than being emitted as literal
+	// addresses, so the machine code does not depend on the process it was generated in and can be cached.
+	extern const char* const defaultMemoryBaseSymbolName;
+	extern const char* const defaultMemorySymbolName;
+	extern const char* const defaultTableBaseSymbolName;
+	extern const char* const defaultTableSymbolName;
+	std::string getImportedFunctionSymbolName(Uptr functionImportIndex);
+	std::string getGlobalSymbolName(Uptr globalIndex);
+	std::string getFunctionTypeSymbolName(Uptr typeIndex);
+	std::string getIntrinsicSymbolName(const char* intrinsicName,const IR::FunctionType* intrinsicType);
+
 	// Emits LLVM IR for a module.
 	llvm::Module* emitModule(const IR::Module& module,ModuleInstance* moduleInstance);
 }
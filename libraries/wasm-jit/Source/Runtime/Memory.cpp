@@ -3,10 +3,14 @@
 #include "Platform/Platform.h"
 #include "RuntimePrivate.h"
 
+#include <mutex>
+
 namespace Runtime
 {
 	// Global lists of memories; used to query whether an address is reserved by one of them.
 	std::vector<MemoryInstance*> memories;
+	// Instances are created and destroyed on the compile threads while traps on other threads query the list.
+	static std::mutex memoriesMutex;
 
 	static Uptr getPlatformPagesPerWebAssemblyPageLog2()
 	{
@@ -46,7 +50,10 @@ namespace Runtime
 		if(growMemory(memory,Uptr(type.size.min)) == -1) { delete memory; return nullptr; }
 
 		// Add the memory to the global array.
-		memories.push_back(memory);
+		{
+			std::lock_guard<std::mutex> lock(memoriesMutex);
+			memories.push_back(memory);
+		}
 		return memory;
 	}
 
@@ -61,6 +68,7 @@ namespace Runtime
 		reservedNumPlatformPages = 0;
 
 		// Remove the memory from the global array.
+		std::lock_guard<std::mutex> lock(memoriesMutex);
 		for(Uptr memoryIndex = 0;memoryIndex < memories.size();++memoryIndex)
 		{
 			if(memories[memoryIndex] == this) { memories.erase(memories.begin() + memoryIndex); break; }
@@ -72,6 +80,7 @@ namespace Runtime
 	bool isAddressOwnedByMemory(U8* address)
 	{
 		// Iterate over all memories and check if the address is within the reserved address space for each.
+		std::lock_guard<std::mutex> lock(memoriesMutex);
 		for(auto memory : memories)
 		{
 			U8* startAddress = memory->reservedBaseAddress;
@@ -98,6 +107,48 @@ namespace Runtime
 			causeException(Exception::Cause::outOfMemory);
    }
 
+	struct MemoryImage
+	{
+		Platform::PageImage* pageImage;
+		Uptr numPlatformPages;
+	};
+
+	MemoryImage* createMemoryImage(const std::vector<U8>& initialContents)
+	{
+		if(initialContents.empty()) { return new MemoryImage {nullptr,0}; }
+		Platform::PageImage* pageImage = Platform::createPageImage(initialContents.data(),initialContents.size());
+		if(!pageImage) { return nullptr; }
+		return new MemoryImage {pageImage,Platform::getPageImageNumPages(pageImage)};
+	}
+
+	void destroyMemoryImage(MemoryImage* image)
+	{
+		if(!image) { return; }
+		Platform::destroyPageImage(image->pageImage);
+		delete image;
+	}
+
+	void resetMemory(MemoryInstance* memory, MemoryType& newMemoryType, const MemoryImage* image) {
+		WAVM_ASSERT_THROW(newMemoryType.size.min <= newMemoryType.size.max);
+		const Uptr previousNumPlatformPages = memory->numPages << getPlatformPagesPerWebAssemblyPageLog2();
+		const Uptr numPlatformPages = Uptr(newMemoryType.size.min) << getPlatformPagesPerWebAssemblyPageLog2();
+		WAVM_ASSERT_THROW(image->numPlatformPages <= numPlatformPages);
+
+		// Replace the mappings instead of clearing them: the image's pages are shared until written to, the rest of
+		// the minimum size gets fresh zero pages, and the pages beyond it become inaccessible again.
+		U8* imageEnd = memory->baseAddress + (image->numPlatformPages << Platform::getPageSizeLog2());
+		if(image->pageImage && !Platform::mapPageImage(memory->baseAddress,image->pageImage))
+			causeException(Exception::Cause::outOfMemory);
+		if(!Platform::resetVirtualPages(imageEnd,numPlatformPages - image->numPlatformPages,Platform::MemoryAccess::ReadWrite))
+			causeException(Exception::Cause::outOfMemory);
+		if(previousNumPlatformPages > numPlatformPages
+		&& !Platform::resetVirtualPages(memory->baseAddress + (numPlatformPages << Platform::getPageSizeLog2()),previousNumPlatformPages - numPlatformPages,Platform::MemoryAccess::None))
+			causeException(Exception::Cause::outOfMemory);
+
+		memory->type = newMemoryType;
+		memory->numPages = Uptr(newMemoryType.size.min);
+	}
+
 	Iptr growMemory(MemoryInstance* memory,Uptr numNewPages)
 	{
 		const Uptr previousNumPages = memory->numPages;
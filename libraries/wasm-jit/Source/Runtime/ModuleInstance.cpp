@@ -30,7 +30,8 @@ namespace Runtime
 
 	MemoryInstance* MemoryInstance::theMemoryInstance = nullptr;
 
-	ModuleInstance* instantiateModule(const IR::Module& module,ImportBindings&& imports)
+	ModuleInstance* instantiateModule(const IR::Module& module,ImportBindings&& imports,ObjectCache* objectCache,const std::string& objectCacheKey,
+		OptimizationLevel optimizationLevel)
 	{
 		ModuleInstance* moduleInstance = new ModuleInstance(
 			std::move(imports.functions),
@@ -130,7 +131,7 @@ namespace Runtime
 		}
 
 		// Generate machine code for the module.
-		LLVMJIT::instantiateModule(module,moduleInstance);
+		LLVMJIT::instantiateModule(module,moduleInstance,objectCache,objectCacheKey,optimizationLevel);
 
 		// Set up the instance's exports.
 		for(const Export& exportIt : module.exports)
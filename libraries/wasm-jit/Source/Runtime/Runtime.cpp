@@ -84,11 +84,16 @@ namespace Runtime
 
 
 	Result invokeFunction(FunctionInstance* function,const std::vector<Value>& parameters)
+	{
+		return invokeFunction(function,parameters.data(),parameters.size());
+	}
+
+	Result invokeFunction(FunctionInstance* function,const Value* parameters,Uptr numParameters)
 	{
 		const FunctionType* functionType = function->type;
 		
 		// Check that the parameter types match the function, and copy them into a memory block that stores each as a 64-bit value.
-		if(parameters.size() != functionType->parameters.size())
+		if(numParameters != functionType->parameters.size())
 		{ 
        throw Exception {Exception::Cause::invokeSignatureMismatch}; 
     }
@@ -105,7 +110,12 @@ namespace Runtime
 		}
 		
 		// Get the invoke thunk for this function type.
-		LLVMJIT::InvokeFunctionPointer invokeFunctionPointer = LLVMJIT::getInvokeThunk(functionType);
+		LLVMJIT::InvokeFunctionPointer invokeFunctionPointer = function->invokeThunk.load(std::memory_order_relaxed);
+		if(!invokeFunctionPointer)
+		{
+			invokeFunctionPointer = LLVMJIT::getInvokeThunk(functionType);
+			function->invokeThunk.store(invokeFunctionPointer,std::memory_order_relaxed);
+		}
 
 		// Catch platform-specific runtime exceptions and turn them into Runtime::Values.
 		Result result;
@@ -20,7 +20,8 @@ namespace LLVMJIT
 	};
 
 	void init();
-	void instantiateModule(const IR::Module& module,Runtime::ModuleInstance* moduleInstance);
+	void instantiateModule(const IR::Module& module,Runtime::ModuleInstance* moduleInstance,ObjectCache* objectCache,const std::string& objectCacheKey,
+		OptimizationLevel optimizationLevel);
 	bool describeInstructionPointer(Uptr ip,std::string& outDescription);
 	
 	typedef void (*InvokeFunctionPointer)(void*,U64*);
@@ -48,8 +49,11 @@ namespace Runtime
 		void* nativeFunction;
 		std::string debugName;
 
+		// The invoke thunk for the function's type, looked up on the first invoke.
+		std::atomic<LLVMJIT::InvokeFunctionPointer> invokeThunk;
+
 		FunctionInstance(ModuleInstance* inModuleInstance,const FunctionType* inType,void* inNativeFunction = nullptr,const char* inDebugName = "<unidentified FunctionInstance>")
-		: GCObject(ObjectKind::function), moduleInstance(inModuleInstance), type(inType), nativeFunction(inNativeFunction), debugName(inDebugName) {}
+		: GCObject(ObjectKind::function), moduleInstance(inModuleInstance), type(inType), nativeFunction(inNativeFunction), debugName(inDebugName), invokeThunk(nullptr) {}
 	};
 
 	// An instance of a WebAssembly Table.
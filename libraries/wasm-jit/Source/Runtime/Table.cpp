@@ -4,10 +4,14 @@
 #include "RuntimePrivate.h"
 #include <eosio/chain/wasm_eosio_constraints.hpp>
 
+#include <mutex>
+
 namespace Runtime
 {
 	// Global lists of tables; used to query whether an address is reserved by one of them.
 	std::vector<TableInstance*> tables;
+	// Instances are created and destroyed on the compile threads while traps on other threads query the list.
+	static std::mutex tablesMutex;
 
 	static Uptr getNumPlatformPages(Uptr numBytes)
 	{
@@ -30,7 +34,10 @@ namespace Runtime
 		if(growTable(table,Uptr(type.size.min)) == -1) { delete table; return nullptr; }
 		
 		// Add the table to the global array.
-		tables.push_back(table);
+		{
+			std::lock_guard<std::mutex> lock(tablesMutex);
+			tables.push_back(table);
+		}
 		return table;
 	}
 	
@@ -46,6 +53,7 @@ namespace Runtime
 		baseAddress = nullptr;
 		
 		// Remove the table from the global array.
+		std::lock_guard<std::mutex> lock(tablesMutex);
 		for(Uptr tableIndex = 0;tableIndex < tables.size();++tableIndex)
 		{
 			if(tables[tableIndex] == this) { tables.erase(tables.begin() + tableIndex); break; }
@@ -55,6 +63,7 @@ namespace Runtime
 	bool isAddressOwnedByTable(U8* address)
 	{
 		// Iterate over all tables and check if the address is within the reserved address space for each.
+		std::lock_guard<std::mutex> lock(tablesMutex);
 		for(auto table : tables)
 		{
 			U8* startAddress = (U8*)table->reservedBaseAddress;
@@ -209,20 +209,81 @@ void chain_plugin::set_program_options(options_description& cli, options_descrip
    cfg.add_options()
          ("blocks-dir", bpo::value<bfs::path>()->default_value("blocks"),
           "the location of the blocks directory (absolute path or relative to application data dir)")
+         ("block-log-mmap-reads", bpo::bool_switch()->default_value(false),
+          "serve block log reads from read-only memory mappings of blocks.log and blocks.index instead of the shared file streams")
+         ("block-log-compression", bpo::value<string>()->default_value("none"),
+          "compression of blocks in newly created block log files (\"none\" or \"zlib\"). "
+          "Compressed block logs use block log version 3 which older versions of nodeos cannot read")
+         ("block-log-index-threads", bpo::value<uint16_t>()->default_value(0),
+          "number of threads verifying blocks while a missing or damaged block log index is reconstructed, 0 for one per core")
+         ("block-log-async-append", bpo::bool_switch()->default_value(false),
+          "write irreversible blocks to the block log from a dedicated thread in batches instead of on the main thread (implies block-log-mmap-reads)")
+         ("block-log-max-pending-blocks", bpo::value<uint32_t>()->default_value(1024),
+          "number of blocks queued for the block log writer thread at which appending waits for it")
+         ("block-log-fsync", bpo::bool_switch()->default_value(false),
+          "fsync the block log after every write, once per batch with block-log-async-append")
+         ("block-log-cache-size-mb", bpo::value<uint64_t>()->default_value(0),
+          "size in MiB of serialized blocks kept in an LRU cache of recently read and written block log blocks, shared by all API and peer requests. 0 (default) disables the cache")
+         ("blocks-log-stride", bpo::value<uint32_t>()->default_value(0),
+          "split the block log into stride files: whenever the head block number is a multiple of the stride, blocks.log and blocks.index "
+          "are renamed to 'blocks-<first>-<last>.log/index' in the retained directory and a new blocks.log is started. 0 disables splitting")
+         ("max-retained-block-files", bpo::value<uint32_t>()->default_value(std::numeric_limits<uint32_t>::max()),
+          "the maximum number of stride files to keep in the retained directory. "
+          "When exceeded, the oldest file is moved to the archive directory, or deleted if no archive directory is configured")
+         ("block-log-retain-blocks", bpo::value<uint32_t>()->default_value(0),
+          "if non-zero, prune the block log to keep only the most recent blocks, at least this many. "
+          "Old blocks are dropped a stride file at a time, so blocks-log-stride must be set as well")
+         ("blocks-retained-dir", bpo::value<bfs::path>()->default_value(""),
+          "the location of the stride files (absolute path or relative to blocks dir). If empty, the blocks dir is used")
+         ("blocks-archive-dir", bpo::value<bfs::path>()->default_value(""),
+          "the location stride files beyond max-retained-block-files are moved to (absolute path or relative to blocks dir). If empty, they are deleted")
          ("protocol-features-dir", bpo::value<bfs::path>()->default_value("protocol_features"),
           "the location of the protocol_features directory (absolute path or relative to application config dir)")
          ("checkpoint", bpo::value<vector<string>>()->composing(), "Pairs of [BLOCK_NUM,BLOCK_ID] that should be enforced as checkpoints.")
-         ("wasm-runtime", bpo::value<eosio::chain::wasm_interface::vm_type>()->value_name("wavm/wabt"), "Override default WASM runtime")
+         ("wasm-runtime", bpo::value<eosio::chain::wasm_interface::vm_type>()->value_name("wavm/wabt/tiered"),
+          "Override default WASM runtime. \"tiered\" runs contracts in wabt and moves those run often to wavm")
+         ("wasm-tier-up-threshold", bpo::value<uint32_t>()->default_value(100),
+          "Number of actions a contract runs before it is compiled again in the background: with wavm when wasm-runtime is tiered, "
+          "at wavm-hot-opt-level when it is wavm")
+         ("wavm-opt-level", bpo::value<uint16_t>()->default_value(1),
+          "Optimization level of the code wavm generates for contracts, from 0 (generated fastest) to 2 (runs fastest)")
+         ("wavm-hot-opt-level", bpo::value<uint16_t>()->default_value(0),
+          "When higher than wavm-opt-level, the level contracts are compiled at in the background once they have run wasm-tier-up-threshold actions")
+         ("wasm-checktime-interval", bpo::value<uint32_t>()->default_value(0),
+          "When set, contracts check the transaction deadline once every this many loop iterations and function calls instead of on each one, "
+          "so that compute heavy contracts run faster at the cost of noticing a deadline later. 0 checks on each one")
+         ("wasm-cache-size-mb", bpo::value<uint64_t>()->default_value(512),
+          "Maximum size (in MiB) of the instantiated contracts kept in memory, counted as the size of their injected code and initial memory. "
+          "Beyond it, the contracts that are cheapest to compile again relative to their size and use are evicted")
+         ("wasm-injected-code-cache-size-mb", bpo::value<uint64_t>()->default_value(64),
+          "Maximum size (in MiB) of the contract code kept in memory after injection, so that contracts evicted from the "
+          "instantiation cache, e.g. after a fork switch, are instantiated again without being parsed and injected again")
+         ("wavm-code-cache-dir", bpo::value<bfs::path>(),
+          "the location where the wavm runtime stores the machine code it generates for contracts, so that it is reused after a restart "
+          "(absolute path or relative to application data dir, e.g. \"code_cache\"). Unset by default, in which case generated code is not stored. "
+          "The stored code is only checked against its own checksum when loaded, so the directory must not be writable by others")
+         ("wavm-code-cache-size-mb", bpo::value<uint64_t>()->default_value(1024),
+          "Maximum size (in MiB) of the wavm code cache, least recently used contracts are removed beyond it")
+         ("wasm-compile-threads", bpo::value<uint16_t>()->default_value(0),
+          "1 compiles contracts on a background thread as soon as setcode stores them, so that their first action does not wait "
+          "for the whole compilation. 0 compiles a contract when it first runs. wavm compiles under a single LLVM context, so no higher value is accepted. "
+          "Only used by the wavm runtime; the tiered runtime always compiles in the background")
          ("abi-serializer-max-time-ms", bpo::value<uint32_t>()->default_value(config::default_abi_serializer_max_time_ms),
           "Override default maximum ABI serialization time allowed in ms")
          ("chain-state-db-size-mb", bpo::value<uint64_t>()->default_value(config::default_state_size / (1024  * 1024)), "Maximum size (in MiB) of the chain state database")
          ("chain-state-db-guard-size-mb", bpo::value<uint64_t>()->default_value(config::default_state_guard_size / (1024  * 1024)), "Safely shut down node when free space remaining in the chain state database drops below this size (in MiB).")
          ("reversible-blocks-db-size-mb", bpo::value<uint64_t>()->default_value(config::default_reversible_cache_size / (1024  * 1024)), "Maximum size (in MiB) of the reversible blocks database")
+         ("reversible-blocks-store", bpo::value<string>()->default_value("database"),
+          "how blocks that are not yet irreversible are stored: \"database\" (a chainbase database) or \"ring-file\" "
+          "(an append-only ring file of reversible-blocks-db-size-mb bytes with an in-memory index). "
+          "Switching to \"ring-file\" imports the blocks of an existing database; the reversible block import, export and fix options only apply to the database")
          ("reversible-blocks-db-guard-size-mb", bpo::value<uint64_t>()->default_value(config::default_reversible_guard_size / (1024  * 1024)), "Safely shut down node when free space remaining in the reverseible blocks database drops below this size (in MiB).")
          ("signature-cpu-billable-pct", bpo::value<uint32_t>()->default_value(config::default_sig_cpu_bill_pct / config::percent_1),
           "Percentage of actual signature recovery cpu to bill. Whole number percentages, e.g. 50 for 50%")
          ("chain-threads", bpo::value<uint16_t>()->default_value(config::default_controller_thread_pool_size),
           "Number of worker threads in controller thread pool")
+         ("replay-prefetch-blocks", bpo::value<uint32_t>()->default_value(config::default_replay_prefetch_blocks),
+          "Number of blocks read from the block log and prepared on the controller thread pool ahead of the block being applied during replay, 0 to read them inline")
          ("contracts-console", bpo::bool_switch()->default_value(false),
           "print contract's output to console")
          ("actor-whitelist", boost::program_options::value<vector<string>>()->composing()->multitoken(),
@@ -639,6 +700,38 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
          my->abi_serializer_max_time_ms = fc::microseconds(options.at("abi-serializer-max-time-ms").as<uint32_t>() * 1000);
 
       my->chain_config->blocks_dir = my->blocks_dir;
+      my->chain_config->blog_config.mmap_reads = options.at( "block-log-mmap-reads" ).as<bool>();
+      my->chain_config->blog_config.stride = options.at( "blocks-log-stride" ).as<uint32_t>();
+      my->chain_config->blog_config.index_threads = options.at( "block-log-index-threads" ).as<uint16_t>();
+      my->chain_config->blog_config.async_append = options.at( "block-log-async-append" ).as<bool>();
+      my->chain_config->blog_config.max_pending_blocks = options.at( "block-log-max-pending-blocks" ).as<uint32_t>();
+      EOS_ASSERT( my->chain_config->blog_config.max_pending_blocks > 0, plugin_config_exception,
+                  "block-log-max-pending-blocks must be greater than 0" );
+      my->chain_config->blog_config.fsync_appends = options.at( "block-log-fsync" ).as<bool>();
+      my->chain_config->blog_config.cache_size = options.at( "block-log-cache-size-mb" ).as<uint64_t>() * 1024*1024;
+      {
+         const auto& compression = options.at( "block-log-compression" ).as<string>();
+         if( compression == "zlib" ) {
+            my->chain_config->blog_config.compression = block_log_compression::zlib;
+         } else {
+            EOS_ASSERT( compression == "none", plugin_config_exception,
+                        "block-log-compression must be \"none\" or \"zlib\", not \"${c}\"", ("c", compression) );
+         }
+      }
+      my->chain_config->blog_config.max_retained_files = options.at( "max-retained-block-files" ).as<uint32_t>();
+      my->chain_config->blog_config.prune_blocks = options.at( "block-log-retain-blocks" ).as<uint32_t>();
+      EOS_ASSERT( !my->chain_config->blog_config.prune_blocks || my->chain_config->blog_config.stride, plugin_config_exception,
+                  "block-log-retain-blocks requires blocks-log-stride, for instance a quarter of the retained blocks" );
+      {
+         auto resolve_blocks_subdir = [&]( const char* option ) {
+            auto dir = options.at( option ).as<bfs::path>();
+            if( dir.empty() || dir.is_absolute() )
+               return dir;
+            return my->blocks_dir / dir;
+         };
+         my->chain_config->blog_config.retained_dir = resolve_blocks_subdir( "blocks-retained-dir" );
+         my->chain_config->blog_config.archive_dir = resolve_blocks_subdir( "blocks-archive-dir" );
+      }
       my->chain_config->state_dir = app().data_dir() / config::default_state_dir_name;
       my->chain_config->read_only = my->readonly;
 
@@ -652,6 +745,16 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
          my->chain_config->reversible_cache_size =
                options.at( "reversible-blocks-db-size-mb" ).as<uint64_t>() * 1024 * 1024;
 
+      {
+         const auto& store = options.at( "reversible-blocks-store" ).as<string>();
+         if( store == "ring-file" ) {
+            my->chain_config->reversible_store = reversible_blocks_store::ring_file;
+         } else {
+            EOS_ASSERT( store == "database", plugin_config_exception,
+                        "reversible-blocks-store must be \"database\" or \"ring-file\", not \"${s}\"", ("s", store) );
+         }
+      }
+
       if( options.count( "reversible-blocks-db-guard-size-mb" ))
          my->chain_config->reversible_guard_size = options.at( "reversible-blocks-db-guard-size-mb" ).as<uint64_t>() * 1024 * 1024;
 
@@ -661,6 +764,9 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
                      "chain-threads ${num} must be greater than 0", ("num", my->chain_config->thread_pool_size) );
       }
 
+      if( options.count( "replay-prefetch-blocks" ))
+         my->chain_config->replay_prefetch_blocks = options.at( "replay-prefetch-blocks" ).as<uint32_t>();
+
       my->chain_config->sig_cpu_bill_pct = options.at("signature-cpu-billable-pct").as<uint32_t>();
       EOS_ASSERT( my->chain_config->sig_cpu_bill_pct >= 0 && my->chain_config->sig_cpu_bill_pct <= 100, plugin_config_exception,
                   "signature-cpu-billable-pct must be 0 - 100, ${pct}", ("pct", my->chain_config->sig_cpu_bill_pct) );
@@ -669,6 +775,30 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
       if( my->wasm_runtime )
          my->chain_config->wasm_runtime = *my->wasm_runtime;
 
+      {
+         if( options.count( "wavm-code-cache-dir" ) ) {
+            const auto& code_cache_dir = options.at( "wavm-code-cache-dir" ).as<bfs::path>();
+            if( !code_cache_dir.empty() )
+               my->chain_config->wasm_config.wavm_code_cache_dir = code_cache_dir.is_relative() ? app().data_dir() / code_cache_dir : code_cache_dir;
+         }
+         my->chain_config->wasm_config.wavm_code_cache_size = options.at( "wavm-code-cache-size-mb" ).as<uint64_t>() * 1024 * 1024;
+         my->chain_config->wasm_config.compile_threads = options.at( "wasm-compile-threads" ).as<uint16_t>();
+         EOS_ASSERT( my->chain_config->wasm_config.compile_threads <= 1, plugin_config_exception,
+                     "wasm-compile-threads must be 0 or 1" );
+         my->chain_config->wasm_config.tier_up_threshold = options.at( "wasm-tier-up-threshold" ).as<uint32_t>();
+         const auto opt_level = options.at( "wavm-opt-level" ).as<uint16_t>();
+         const auto hot_opt_level = options.at( "wavm-hot-opt-level" ).as<uint16_t>();
+         EOS_ASSERT( opt_level <= 2 && hot_opt_level <= 2, plugin_config_exception,
+                     "wavm-opt-level and wavm-hot-opt-level must be between 0 and 2" );
+         my->chain_config->wasm_config.wavm_opt_level = opt_level;
+         my->chain_config->wasm_config.wavm_hot_opt_level = hot_opt_level;
+         my->chain_config->wasm_config.checktime_interval = options.at( "wasm-checktime-interval" ).as<uint32_t>();
+         my->chain_config->wasm_config.injected_code_cache_size = options.at( "wasm-injected-code-cache-size-mb" ).as<uint64_t>() * 1024 * 1024;
+         my->chain_config->wasm_config.instantiation_cache_size = options.at( "wasm-cache-size-mb" ).as<uint64_t>() * 1024 * 1024;
+         EOS_ASSERT( my->chain_config->wasm_config.checktime_interval <= uint32_t(std::numeric_limits<int32_t>::max()), plugin_config_exception,
+                     "wasm-checktime-interval is too large" );
+      }
+
       my->chain_config->force_all_checks = options.at( "force-all-checks" ).as<bool>();
       my->chain_config->disable_replay_opts = options.at( "disable-replay-opts" ).as<bool>();
       my->chain_config->contracts_console = options.at( "contracts-console" ).as<bool>();
@@ -728,11 +858,21 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
             wlog( "The --truncate-at-block option does not make sense when deleting all blocks." );
          clear_directory_contents( my->chain_config->state_dir );
          fc::remove_all( my->blocks_dir );
+         if( !my->chain_config->blog_config.retained_dir.empty() )
+            fc::remove_all( my->chain_config->blog_config.retained_dir );
       } else if( options.at( "hard-replay-blockchain" ).as<bool>()) {
          ilog( "Hard replay requested: deleting state database" );
          clear_directory_contents( my->chain_config->state_dir );
-         auto backup_dir = block_log::repair_log( my->blocks_dir, options.at( "truncate-at-block" ).as<uint32_t>());
-         if( fc::exists( backup_dir / config::reversible_blocks_dir_name ) ||
+         auto backup_dir = block_log::repair_log( my->blocks_dir, options.at( "truncate-at-block" ).as<uint32_t>(),
+                                                  my->chain_config->blog_config.retained_dir );
+         const auto backup_ring_file = backup_dir / config::reversible_blocks_dir_name / config::reversible_blocks_ring_file_name;
+         if( my->chain_config->reversible_store == reversible_blocks_store::ring_file && fc::exists( backup_ring_file ) ) {
+            // records of the ring file are checksummed, damaged ones are dropped when it is opened
+            ilog( "Copying reversible block log from backup to blocks directory." );
+            fc::create_directories( my->chain_config->blocks_dir / config::reversible_blocks_dir_name );
+            fc::copy( backup_ring_file,
+                      my->chain_config->blocks_dir / config::reversible_blocks_dir_name / config::reversible_blocks_ring_file_name );
+         } else if( fc::exists( backup_dir / config::reversible_blocks_dir_name ) ||
              options.at( "fix-reversible-blocks" ).as<bool>()) {
             // Do not try to recover reversible blocks if the directory does not exist, unless the option was explicitly provided.
             if( !recover_reversible_blocks( backup_dir / config::reversible_blocks_dir_name,
@@ -1726,6 +1866,11 @@ read_only::get_producer_schedule_result read_only::get_producer_schedule( const
    return result;
 }
 
+read_only::get_wasm_stats_result read_only::get_wasm_stats( const read_only::get_wasm_stats_params& ) const {
+   const auto& wasmif = db.get_wasm_interface();
+   return { wasmif.get_cache_stats(), wasmif.get_contract_stats() };
+}
+
 template<typename Api>
 struct resolver_factory {
    static auto make(const Api* api, const fc::microseconds& max_serialization_time) {
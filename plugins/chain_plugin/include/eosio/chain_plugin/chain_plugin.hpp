@@ -369,6 +369,15 @@ public:
 
    get_producer_schedule_result get_producer_schedule( const get_producer_schedule_params& params )const;
 
+   using get_wasm_stats_params = empty;
+
+   struct get_wasm_stats_result {
+      chain::wasm_cache_stats              cache;
+      vector<chain::wasm_contract_stats>   contracts; ///< of the contracts currently instantiated
+   };
+
+   get_wasm_stats_result get_wasm_stats( const get_wasm_stats_params& params )const;
+
    struct get_scheduled_transactions_params {
       bool        json = false;
       string      lower_bound;  /// timestamp OR transaction ID
@@ -754,6 +763,8 @@ FC_REFLECT( eosio::chain_apis::read_only::get_producers_result, (rows)(total_pro
 FC_REFLECT_EMPTY( eosio::chain_apis::read_only::get_producer_schedule_params )
 FC_REFLECT( eosio::chain_apis::read_only::get_producer_schedule_result, (active)(pending)(proposed) );
 
+FC_REFLECT( eosio::chain_apis::read_only::get_wasm_stats_result, (cache)(contracts) );
+
 FC_REFLECT( eosio::chain_apis::read_only::get_scheduled_transactions_params, (json)(lower_bound)(limit) )
 FC_REFLECT( eosio::chain_apis::read_only::get_scheduled_transactions_result, (transactions)(more) );
 
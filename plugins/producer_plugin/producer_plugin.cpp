@@ -433,6 +433,8 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
             if( future.valid() )
                future.wait();
             app().post(priority::low, [self, trx, persist_until_expired, next]() {
+               // transactions waiting for a block to be built find their contracts compiled
+               self->chain_plug->chain().precompile_contracts( trx );
                self->process_incoming_transaction_async( trx, persist_until_expired, next );
             });
          });
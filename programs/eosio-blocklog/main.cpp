@@ -6,16 +6,22 @@
 #include <eosio/chain/block_log.hpp>
 #include <eosio/chain/config.hpp>
 #include <eosio/chain/reversible_block_object.hpp>
+#include <eosio/chain/thread_utils.hpp>
 
 #include <fc/io/json.hpp>
+#include <fc/io/raw.hpp>
 #include <fc/filesystem.hpp>
 #include <fc/variant.hpp>
 
 #include <boost/exception/diagnostic_information.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/path.hpp>
 
+#include <deque>
+#include <thread>
+
 using namespace eosio::chain;
 namespace bfs = boost::filesystem;
 namespace bpo = boost::program_options;
@@ -27,6 +33,8 @@ struct blocklog {
    {}
 
    void read_log();
+   void trim_log();
+   void verify_log();
    void set_program_options(options_description& cli);
    void initialize(const variables_map& options);
 
@@ -36,15 +44,56 @@ struct blocklog {
    uint32_t                         last_block;
    bool                             no_pretty_print;
    bool                             as_json_array;
+   std::string                      output_format;
+   uint16_t                         jobs = 0;
+   bool                             trim = false;
+   bool                             verify = false;
+
+   private:
+      /// blocks handed to one worker at a time
+      static constexpr uint32_t blocks_per_task = 256;
+
+      std::string format_block(const signed_block_ptr& b)const;
 };
 
+std::string blocklog::format_block(const signed_block_ptr& b)const {
+   if (output_format == "binary") {
+      const auto data = fc::raw::pack(*b);
+      return std::string(data.begin(), data.end());
+   }
+
+   fc::variant pretty_output;
+   const fc::microseconds deadline = fc::seconds(10);
+   abi_serializer::to_variant(*b,
+                              pretty_output,
+                              []( account_name n ) { return optional<abi_serializer>(); },
+                              deadline);
+   const auto block_id = b->id();
+   const uint32_t ref_block_prefix = block_id._hash[1];
+   const auto enhanced_object = fc::mutable_variant_object
+              ("block_num",b->block_num())
+              ("id", block_id)
+              ("ref_block_prefix", ref_block_prefix)
+              (pretty_output.get_object());
+   fc::variant v(std::move(enhanced_object));
+   if (output_format == "ndjson")
+      return fc::json::to_string(v, fc::json::stringify_large_ints_and_doubles) + "\n";
+   if (no_pretty_print)
+      return fc::json::to_string(v, fc::json::stringify_large_ints_and_doubles);
+   return fc::json::to_pretty_string(v) + "\n";
+}
+
 void blocklog::read_log() {
-   block_log block_logger(blocks_dir);
+   // memory mapped reads let the workers read the log concurrently
+   block_log_config cfg;
+   cfg.mmap_reads = true;
+   block_log block_logger(blocks_dir, cfg);
    const auto end = block_logger.read_head();
    EOS_ASSERT( end, block_log_exception, "No blocks found in block log" );
    EOS_ASSERT( end->block_num() > 1, block_log_exception, "Only one block found in block log" );
 
-   ilog( "existing block log contains block num 1 through block num ${n}", ("n",end->block_num()) );
+   ilog( "existing block log contains block num ${first} through block num ${n}",
+         ("first",block_logger.first_block_num())("n",end->block_num()) );
 
    optional<chainbase::database> reversible_blocks;
    try {
@@ -72,7 +121,7 @@ void blocklog::read_log() {
    std::ofstream output_blocks;
    std::ostream* out;
    if (!output_file.empty()) {
-      output_blocks.open(output_file.generic_string().c_str());
+      output_blocks.open(output_file.generic_string().c_str(), std::ios::out | std::ios::binary);
       if (output_blocks.fail()) {
          std::ostringstream ss;
          ss << "Unable to open file '" << output_file.string() << "'";
@@ -83,53 +132,208 @@ void blocklog::read_log() {
    else
       out = &std::cout;
 
-   if (as_json_array)
+   const bool json_array = as_json_array && output_format == "json";
+   if (json_array)
       *out << "[";
-   uint32_t block_num = (first_block < 1) ? 1 : first_block;
-   signed_block_ptr next;
-   fc::variant pretty_output;
-   const fc::microseconds deadline = fc::seconds(10);
-   auto print_block = [&](signed_block_ptr& next) {
-      abi_serializer::to_variant(*next,
-                                 pretty_output,
-                                 []( account_name n ) { return optional<abi_serializer>(); },
-                                 deadline);
-      const auto block_id = next->id();
-      const uint32_t ref_block_prefix = block_id._hash[1];
-      const auto enhanced_object = fc::mutable_variant_object
-                 ("block_num",next->block_num())
-                 ("id", block_id)
-                 ("ref_block_prefix", ref_block_prefix)
-                 (pretty_output.get_object());
-      fc::variant v(std::move(enhanced_object));
-       if (no_pretty_print)
-          fc::json::to_stream(*out, v, fc::json::stringify_large_ints_and_doubles);
-       else
-          *out << fc::json::to_pretty_string(v) << "\n";
-   };
    bool contains_obj = false;
-   while((block_num <= last_block) && (next = block_logger.read_block_by_num( block_num ))) {
-      if (as_json_array && contains_obj)
+   auto print_block = [&](const std::string& formatted) {
+      if (json_array && contains_obj)
          *out << ",";
-      print_block(next);
-      ++block_num;
+      *out << formatted;
       contains_obj = true;
+   };
+
+   uint32_t block_num = std::max( std::max(first_block, 1u), block_logger.first_block_num() );
+   const uint32_t log_last = std::min( last_block, end->block_num() );
+   if (block_num <= log_last) {
+      // workers format ranges of blocks while the main thread writes the finished ranges in order
+      named_thread_pool pool( "blklog", jobs );
+      std::deque<std::future<std::vector<std::string>>> tasks;
+      uint64_t next_task_first = block_num;
+      auto submit = [&]() {
+         const uint32_t task_first = next_task_first;
+         const uint32_t task_last = std::min<uint64_t>( uint64_t(task_first) + blocks_per_task - 1, log_last );
+         next_task_first = uint64_t(task_last) + 1;
+         tasks.emplace_back( async_thread_pool( pool.get_executor(), [this, &block_logger, task_first, task_last]() {
+            std::vector<std::string> formatted;
+            formatted.reserve( task_last - task_first + 1 );
+            for( uint32_t n = task_first; n <= task_last; ++n ) {
+               auto b = block_logger.read_block_by_num( n );
+               EOS_ASSERT( b, block_log_exception, "Block ${n} is missing from the block log", ("n", n) );
+               formatted.emplace_back( format_block( b ) );
+            }
+            return formatted;
+         } ) );
+      };
+
+      const size_t max_tasks = size_t(jobs) * 4;
+      while (!tasks.empty() || next_task_first <= log_last) {
+         while (tasks.size() < max_tasks && next_task_first <= log_last)
+            submit();
+         for (const auto& formatted : tasks.front().get())
+            print_block(formatted);
+         tasks.pop_front();
+      }
+      block_num = log_last + 1;
    }
+
    if (reversible_blocks) {
       const reversible_block_object* obj = nullptr;
       while( (block_num <= last_block) && (obj = reversible_blocks->find<reversible_block_object,by_num>(block_num)) ) {
-         if (as_json_array && contains_obj)
-            *out << ",";
-         auto next = obj->get_block();
-         print_block(next);
+         print_block(format_block(obj->get_block()));
          ++block_num;
-         contains_obj = true;
       }
    }
-   if (as_json_array)
+   if (json_array)
       *out << "]";
 }
 
+/**
+ * Keeps only blocks [first_block, last_block] of blocks.log. Trimming only the back truncates the files in place,
+ * trimming the front writes a new blocks.log that records first_block as its first block, shifting every position.
+ */
+void blocklog::trim_log() {
+   const auto log_file = blocks_dir / "blocks.log";
+   const auto index_file = blocks_dir / "blocks.index";
+
+   uint32_t log_first = 0;
+   uint32_t head_num = 0;
+   uint64_t start_pos = 0;
+   uint64_t end_pos = 0;
+   {
+      block_log block_logger(blocks_dir);
+      EOS_ASSERT( block_logger.head(), block_log_exception, "No blocks found in block log" );
+      log_first = block_logger.first_block_num();
+      head_num = block_logger.head()->block_num();
+      last_block = std::min( last_block, head_num );
+      first_block = std::max( first_block, log_first );
+      EOS_ASSERT( first_block <= last_block, block_log_exception,
+                  "Nothing would remain of the block log holding blocks ${f} through ${l}", ("f", log_first)("l", head_num) );
+      EOS_ASSERT( first_block != log_first || last_block != head_num, block_log_exception,
+                  "The block log already holds exactly blocks ${f} through ${l}", ("f", log_first)("l", head_num) );
+
+      start_pos = block_logger.get_block_pos( first_block );
+      EOS_ASSERT( start_pos != block_log::npos, block_log_exception,
+                  "Block ${n} is in a stride file, only blocks.log can be trimmed; remove whole stride files instead", ("n", first_block) );
+      end_pos = last_block == head_num ? bfs::file_size( log_file ) : block_logger.get_block_pos( last_block + 1 );
+   }
+
+   // the first block of blocks.log itself; earlier blocks live in stride files and are left alone
+   uint32_t file_first = 0;
+   uint32_t version = 0;
+   {
+      std::ifstream header( log_file.generic_string(), std::ios::in | std::ios::binary );
+      header.read( (char*)&version, sizeof(version) );
+      file_first = 1;
+      if (version != 1)
+         header.read( (char*)&file_first, sizeof(file_first) );
+   }
+
+   if (first_block == file_first) {
+      ilog( "Truncating block log after block ${n}", ("n", last_block) );
+      bfs::resize_file( log_file, end_pos );
+      bfs::resize_file( index_file, sizeof(uint64_t) * (uint64_t(last_block) - file_first + 1) );
+      return;
+   }
+
+   ilog( "Writing block log holding blocks ${f} through ${l}", ("f", first_block)("l", last_block) );
+   const auto genesis = block_log::extract_genesis_state( blocks_dir );
+   const auto new_log_file = blocks_dir / "blocks.log.trim";
+   const auto new_index_file = blocks_dir / "blocks.index.trim";
+   {
+      boost::iostreams::mapped_file_source old_log( log_file.generic_string() );
+      boost::iostreams::mapped_file_source old_index( index_file.generic_string() );
+
+      std::ofstream new_log( new_log_file.generic_string(), std::ios::out | std::ios::binary | std::ios::trunc );
+      std::ofstream new_index( new_index_file.generic_string(), std::ios::out | std::ios::binary | std::ios::trunc );
+      new_log.exceptions( std::ios::failbit | std::ios::badbit );
+      new_index.exceptions( std::ios::failbit | std::ios::badbit );
+
+      // version 1 has no room for the first block number, its blocks are stored the same way in version 2
+      const uint32_t new_version = std::max( version, 2u );
+      const auto genesis_data = fc::raw::pack( genesis );
+      const uint64_t totem = block_log::npos;
+      new_log.write( (const char*)&new_version, sizeof(new_version) );
+      new_log.write( (const char*)&first_block, sizeof(first_block) );
+      new_log.write( genesis_data.data(), genesis_data.size() );
+      new_log.write( (const char*)&totem, sizeof(totem) );
+      const uint64_t header_size = sizeof(new_version) + sizeof(first_block) + genesis_data.size() + sizeof(totem);
+
+      // entries are copied unchanged, only the trailing positions move
+      for( uint32_t n = first_block; n <= last_block; ++n ) {
+         uint64_t pos;
+         memcpy( &pos, old_index.data() + sizeof(uint64_t) * (n - file_first), sizeof(pos) );
+         uint64_t next_pos = end_pos;
+         if( n < last_block )
+            memcpy( &next_pos, old_index.data() + sizeof(uint64_t) * (n + 1 - file_first), sizeof(next_pos) );
+         const uint64_t new_pos = pos - start_pos + header_size;
+         new_log.write( old_log.data() + pos, next_pos - pos - sizeof(uint64_t) );
+         new_log.write( (const char*)&new_pos, sizeof(new_pos) );
+         new_index.write( (const char*)&new_pos, sizeof(new_pos) );
+      }
+   }
+
+   bfs::rename( new_log_file, log_file );
+   bfs::rename( new_index_file, index_file );
+   ilog( "Block log trimmed to blocks ${f} through ${l}", ("f", first_block)("l", last_block) );
+}
+
+/**
+ * Checks in parallel that every block decodes as the expected block number and links to the id of the block before it.
+ */
+void blocklog::verify_log() {
+   block_log_config cfg;
+   cfg.mmap_reads = true;
+   block_log block_logger(blocks_dir, cfg);
+   EOS_ASSERT( block_logger.head(), block_log_exception, "No blocks found in block log" );
+
+   const uint32_t first = std::max( std::max(first_block, 1u), block_logger.first_block_num() );
+   const uint32_t last = std::min( last_block, block_logger.head()->block_num() );
+   EOS_ASSERT( first <= last, block_log_exception, "No blocks in the requested range" );
+   ilog( "Verifying blocks ${f} through ${l}", ("f", first)("l", last) );
+   const auto start = fc::time_point::now();
+
+   struct range_ids {
+      block_id_type first_previous;
+      block_id_type last_id;
+   };
+   named_thread_pool pool( "blklog", jobs );
+   std::vector<std::future<range_ids>> tasks;
+   for( uint64_t task_first = first; task_first <= last; task_first += blocks_per_task ) {
+      const uint32_t task_last = std::min<uint64_t>( task_first + blocks_per_task - 1, last );
+      tasks.emplace_back( async_thread_pool( pool.get_executor(), [&block_logger, task_first, task_last]() {
+         range_ids result;
+         for( uint32_t n = task_first; n <= task_last; ++n ) {
+            auto b = block_logger.read_block_by_num( n );
+            EOS_ASSERT( b, block_log_exception, "Block ${n} is missing from the block log", ("n", n) );
+            if( n == task_first )
+               result.first_previous = b->previous;
+            else
+               EOS_ASSERT( b->previous == result.last_id, block_log_exception,
+                           "Block ${n} does not link to block ${p}", ("n", n)("p", n - 1) );
+            result.last_id = b->id();
+         }
+         return result;
+      } ) );
+   }
+
+   // ranges are checked against each other in order
+   block_id_type last_id;
+   uint32_t range_first = first;
+   for( auto& t : tasks ) {
+      const auto ids = t.get();
+      if( range_first != first )
+         EOS_ASSERT( ids.first_previous == last_id, block_log_exception,
+                     "Block ${n} does not link to block ${p}", ("n", range_first)("p", range_first - 1) );
+      last_id = ids.last_id;
+      range_first += blocks_per_task;
+   }
+
+   const auto elapsed = fc::time_point::now() - start;
+   ilog( "Verified ${n} blocks in ${s} ms, head block id ${id}",
+         ("n", last - first + 1)("s", elapsed.count() / 1000)("id", last_id) );
+}
+
 void blocklog::set_program_options(options_description& cli)
 {
    cli.add_options()
@@ -145,6 +349,14 @@ void blocklog::set_program_options(options_description& cli)
           "Do not pretty print the output.  Useful if piping to jq to improve performance.")
          ("as-json-array", bpo::bool_switch(&as_json_array)->default_value(false),
           "Print out json blocks wrapped in json array (otherwise the output is free-standing json objects).")
+         ("output-format", bpo::value<std::string>(&output_format)->default_value("json"),
+          "Format of the output: \"json\", \"ndjson\" (one json block per line) or \"binary\" (the packed blocks back to back).")
+         ("jobs,j", bpo::value<uint16_t>(&jobs)->default_value(0),
+          "Number of threads decoding and formatting blocks. 0 for one per core.")
+         ("trim-blocklog", bpo::bool_switch(&trim)->default_value(false),
+          "Trim blocks.log and its index in place to the blocks from --first through --last instead of printing them.")
+         ("verify", bpo::bool_switch(&verify)->default_value(false),
+          "Verify the ids and previous links of the blocks from --first through --last instead of printing them.")
          ("help", "Print this help message and exit.")
          ;
 
@@ -165,6 +377,12 @@ void blocklog::initialize(const variables_map& options) {
          else
             output_file = bld;
       }
+
+      EOS_ASSERT( output_format == "json" || output_format == "ndjson" || output_format == "binary", fc::invalid_arg_exception,
+                  "Unknown output format '${f}'", ("f", output_format) );
+      EOS_ASSERT( !(trim && verify), fc::invalid_arg_exception, "Only one of --trim-blocklog and --verify can be given" );
+      if (jobs == 0)
+         jobs = std::max( 1u, std::thread::hardware_concurrency() );
    } FC_LOG_AND_RETHROW()
 
 }
@@ -185,7 +403,12 @@ int main(int argc, char** argv)
         return 0;
       }
       blog.initialize(vmap);
-      blog.read_log();
+      if (blog.trim)
+         blog.trim_log();
+      else if (blog.verify)
+         blog.verify_log();
+      else
+         blog.read_log();
    } catch( const fc::exception& e ) {
       elog( "${e}", ("e", e.to_detail_string()));
       return -1;
@@ -42,6 +42,8 @@
 
 #include <contracts.hpp>
 
+#include "test_wasts.hpp"
+
 #define DUMMY_ACTION_DEFAULT_A 0x45
 #define DUMMY_ACTION_DEFAULT_B 0xab11cd1244556677
 #define DUMMY_ACTION_DEFAULT_C 0x7451ae12
@@ -924,6 +926,29 @@ BOOST_AUTO_TEST_CASE(checktime_fail_tests) { try {
 } FC_LOG_AND_RETHROW() }
 
 
+BOOST_AUTO_TEST_CASE(checktime_interval_tests) { try {
+   fc::temp_directory tempdir;
+   auto cfg = validating_tester::default_config();
+   cfg.blocks_dir = tempdir.path() / config::default_blocks_dir_name;
+   cfg.state_dir = tempdir.path() / config::default_state_dir_name;
+   cfg.wasm_config.checktime_interval = 1000;
+
+   TESTER t( cfg );
+   t.produce_blocks(2);
+   t.create_account( N(testapi) );
+   t.set_code( N(testapi), contracts::test_api_wasm() );
+   t.produce_blocks(1);
+
+   // checktime is called on fewer loop iterations, but a runaway loop still hits the deadline
+   call_test( t, test_api_action<TEST_METHOD("test_checktime", "checktime_pass")>{}, 0 );
+   BOOST_CHECK_EXCEPTION( call_test( t, test_api_action<TEST_METHOD("test_checktime", "checktime_failure")>{},
+                                     5000, 200, fc::raw::pack(10000000000000000000ULL) ),
+                          deadline_exception, is_deadline_exception );
+   BOOST_CHECK_EXCEPTION( call_test( t, test_api_action<TEST_METHOD("test_checktime", "checktime_failure")>{},
+                                     0, 200, fc::raw::pack(10000000000000000000ULL) ),
+                          tx_cpu_usage_exceeded, is_tx_cpu_usage_exceeded );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_FIXTURE_TEST_CASE(checktime_intrinsic, TESTER) { try {
 	produce_blocks(2);
 	create_account( N(testapi) );
@@ -1665,6 +1690,76 @@ BOOST_FIXTURE_TEST_CASE(db_tests, TESTER) { try {
    BOOST_REQUIRE_EQUAL( validate(), true );
 } FC_LOG_AND_RETHROW() }
 
+/*************************************************************************************
+ * db_lookups_within_transaction test case
+ *************************************************************************************/
+BOOST_FIXTURE_TEST_CASE(db_lookups_within_transaction, TESTER) { try {
+   produce_blocks(2);
+   create_account( N(dbcache) );
+   produce_block();
+   set_code( N(dbcache), table_row_lookups_wast );
+   produce_blocks(1);
+
+   auto act = []( action_name name, uint64_t id = 0 ) {
+      return action( vector<permission_level>{{N(dbcache), config::active_name}}, N(dbcache), name, fc::raw::pack(id) );
+   };
+   auto push = [&]( vector<action> actions ) {
+      signed_transaction trx;
+      trx.actions = std::move(actions);
+      set_transaction_headers(trx);
+      trx.sign( get_private_key( N(dbcache), "active" ), control->get_chain_id() );
+      return push_transaction( trx );
+   };
+   auto has_row = [&]( uint64_t id ) {
+      return !get_row_by_account( N(dbcache), N(dbcache), N(rows), account_name(id) ).empty();
+   };
+
+   // a row stored and removed again in the same transaction is not found, the other rows of its table are
+   push( { act( N(hasnot), 1 ), act( N(store), 1 ), act( N(store), 2 ), act( N(has), 1 ),
+           act( N(remove), 1 ), act( N(hasnot), 1 ), act( N(has), 2 ) } );
+   BOOST_CHECK( !has_row(1) );
+   BOOST_CHECK( has_row(2) );
+
+   // removing the last row removes the table, the next store creates it again
+   push( { act( N(remove), 2 ), act( N(hasnot), 2 ), act( N(store), 1 ), act( N(has), 1 ), act( N(hasnot), 2 ),
+           act( N(remove), 1 ), act( N(hasnot), 1 ), act( N(store), 2 ), act( N(has), 2 ) } );
+   BOOST_CHECK( !has_row(1) );
+   BOOST_CHECK( has_row(2) );
+
+   // the rows a failed transaction stored and looked up are gone with it
+   BOOST_CHECK_THROW( push( { act( N(store), 3 ), act( N(has), 3 ), act( N(fail) ) } ), eosio_assert_message_exception );
+   push( { act( N(hasnot), 3 ), act( N(has), 2 ) } );
+   BOOST_CHECK( !has_row(3) );
+
+   // a failed deferred transaction is undone before its sender handles onerror, which stores row 3 again
+   signed_transaction dtrx;
+   dtrx.actions = { act( N(store), 3 ), act( N(has), 3 ), act( N(fail) ) };
+   set_transaction_headers( dtrx );
+   push( { action( vector<permission_level>{{N(dbcache), config::active_name}}, N(dbcache), N(defer),
+                   fc::raw::pack( static_cast<const transaction&>(dtrx) ) ) } );
+
+   const auto& idx = control->db().get_index<generated_transaction_multi_index, by_trx_id>();
+   BOOST_REQUIRE_EQUAL( 1u, idx.size() );
+   auto deferred_id = idx.begin()->trx_id;
+
+   transaction_trace_ptr onerror_trace;
+   auto c = control->applied_transaction.connect( [&]( std::tuple<const transaction_trace_ptr&, const signed_transaction&> x ) {
+      if( std::get<0>(x)->failed_dtrx_trace ) onerror_trace = std::get<0>(x);
+   } );
+   produce_block();
+   c.disconnect();
+
+   BOOST_REQUIRE( onerror_trace );
+   BOOST_CHECK( !onerror_trace->except );
+   BOOST_CHECK( onerror_trace->failed_dtrx_trace->except );
+   BOOST_CHECK_EQUAL( 0u, idx.size() );
+   BOOST_CHECK_EQUAL( get_transaction_receipt( deferred_id ).status, transaction_receipt::soft_fail );
+   BOOST_CHECK( has_row(2) );
+   BOOST_CHECK( has_row(3) );
+
+   BOOST_REQUIRE_EQUAL( validate(), true );
+} FC_LOG_AND_RETHROW() }
+
 /*************************************************************************************
  * multi_index_tests test case
  *************************************************************************************/
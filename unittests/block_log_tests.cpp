@@ -0,0 +1,476 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include <eosio/chain/block_log.hpp>
+#include <eosio/testing/tester.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <thread>
+
+using namespace eosio;
+using namespace eosio::chain;
+using namespace eosio::testing;
+
+BOOST_AUTO_TEST_SUITE(block_log_tests)
+
+BOOST_AUTO_TEST_CASE(mmap_reads_match_stream_reads) { try {
+   tester chain;
+   chain.produce_blocks(30);
+   chain.close();
+
+   const auto& blocks_dir = chain.get_config().blocks_dir;
+   block_log stream_log( blocks_dir );
+   block_log_config cfg;
+   cfg.mmap_reads = true;
+   block_log mapped_log( blocks_dir, cfg );
+
+   BOOST_REQUIRE( stream_log.head() );
+   BOOST_REQUIRE( mapped_log.head() );
+   const auto head_num = stream_log.head()->block_num();
+   BOOST_REQUIRE_EQUAL( mapped_log.head()->block_num(), head_num );
+
+   for( uint32_t n = 1; n <= head_num; ++n ) {
+      BOOST_REQUIRE_EQUAL( mapped_log.get_block_pos( n ), stream_log.get_block_pos( n ) );
+      BOOST_REQUIRE_EQUAL( mapped_log.read_block_by_num( n )->id(), stream_log.read_block_by_num( n )->id() );
+   }
+   BOOST_CHECK( !mapped_log.read_block_by_num( head_num + 1 ) );
+   BOOST_CHECK_EQUAL( mapped_log.get_block_pos( head_num + 1 ), block_log::npos );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(reads_concurrent_with_append) { try {
+   tester chain;
+   chain.produce_blocks(60);
+   chain.close();
+
+   const auto& blocks_dir = chain.get_config().blocks_dir;
+   block_log source( blocks_dir );
+   const auto head_num = source.head()->block_num();
+
+   // stream reads take turns with each other and with the appends, mapped reads run in parallel
+   for( bool mmap_reads : { false, true } ) {
+      fc::temp_directory tempdir;
+      block_log_config cfg;
+      cfg.mmap_reads = mmap_reads;
+      block_log target( tempdir.path(), cfg );
+      target.reset( block_log::extract_genesis_state( blocks_dir ), source.read_block_by_num( 1 ) );
+
+      std::atomic<bool> done{false};
+      std::atomic<uint32_t> mismatches{0};
+      std::vector<std::thread> readers;
+      for( int i = 0; i < 4; ++i ) {
+         readers.emplace_back( [&]() {
+            while( !done ) {
+               for( uint32_t n = 1; n <= head_num; ++n ) {
+                  auto b = target.read_block_by_num( n );
+                  if( !b ) break;
+                  if( b->block_num() != n ) ++mismatches;
+                  const auto pos = target.get_block_pos( n );
+                  if( pos != block_log::npos && target.read_block( pos ).first->block_num() != n ) ++mismatches;
+               }
+            }
+         } );
+      }
+
+      for( uint32_t n = 2; n <= head_num; ++n ) {
+         target.append( source.read_block_by_num( n ) );
+      }
+      done = true;
+      for( auto& t : readers ) t.join();
+
+      BOOST_CHECK_EQUAL( mismatches.load(), 0u );
+      BOOST_CHECK_EQUAL( target.read_block_by_num( head_num )->id(), source.head()->id() );
+   }
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(stride_files) { try {
+   tester chain;
+   chain.produce_blocks(45);
+   chain.close();
+
+   const auto& blocks_dir = chain.get_config().blocks_dir;
+   block_log source( blocks_dir );
+   const auto head_num = source.head()->block_num();
+   const uint32_t num_strides = head_num / 10;
+   BOOST_REQUIRE_GT( num_strides, 2u );
+
+   fc::temp_directory tempdir;
+   block_log_config cfg;
+   cfg.stride = 10;
+   {
+      block_log target( tempdir.path(), cfg );
+      target.reset( block_log::extract_genesis_state( blocks_dir ), source.read_block_by_num( 1 ) );
+      for( uint32_t n = 2; n <= head_num; ++n ) {
+         target.append( source.read_block_by_num( n ) );
+      }
+
+      for( uint32_t i = 0; i < num_strides; ++i ) {
+         const auto stem = "blocks-" + std::to_string( i * 10 + 1 ) + "-" + std::to_string( i * 10 + 10 );
+         BOOST_CHECK( fc::exists( tempdir.path() / (stem + ".log") ) );
+         BOOST_CHECK( fc::exists( tempdir.path() / (stem + ".index") ) );
+      }
+      BOOST_CHECK_EQUAL( target.first_block_num(), 1u );
+      BOOST_CHECK_EQUAL( target.head()->id(), source.head()->id() );
+      for( uint32_t n = 1; n <= head_num; ++n ) {
+         BOOST_REQUIRE_EQUAL( target.read_block_by_num( n )->id(), source.read_block_by_num( n )->id() );
+      }
+   }
+
+   // a lost stride index is rebuilt on open and files beyond the retention limit are archived
+   fc::remove( tempdir.path() / "blocks-11-20.index" );
+   cfg.max_retained_files = 2;
+   cfg.archive_dir = tempdir.path() / "archive";
+   cfg.mmap_reads = true;
+   block_log target( tempdir.path(), cfg );
+
+   const uint32_t first_retained = (num_strides - 2) * 10 + 1;
+   BOOST_CHECK_EQUAL( target.first_block_num(), first_retained );
+   BOOST_CHECK( fc::exists( cfg.archive_dir / "blocks-1-10.log" ) );
+   BOOST_CHECK( fc::exists( cfg.archive_dir / "blocks-11-20.index" ) );
+   BOOST_CHECK( !target.read_block_by_num( first_retained - 1 ) );
+   for( uint32_t n = first_retained; n <= head_num; ++n ) {
+      BOOST_REQUIRE_EQUAL( target.read_block_by_num( n )->id(), source.read_block_by_num( n )->id() );
+   }
+   BOOST_CHECK_EQUAL( target.read_head()->id(), source.head()->id() );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(retained_dir_stride_files) { try {
+   tester chain;
+   chain.produce_blocks(35);
+   chain.close();
+
+   const auto& blocks_dir = chain.get_config().blocks_dir;
+   block_log source( blocks_dir );
+   const auto head_num = source.head()->block_num();
+
+   fc::temp_directory tempdir;
+   const auto target_dir = tempdir.path() / "blocks";
+   block_log_config cfg;
+   cfg.stride = 10;
+   {
+      block_log target( target_dir, cfg );
+      target.reset( block_log::extract_genesis_state( blocks_dir ), source.read_block_by_num( 1 ) );
+      for( uint32_t n = 2; n <= head_num; ++n ) {
+         target.append( source.read_block_by_num( n ) );
+      }
+   }
+
+   // stride files left in the blocks directory are moved once a retained directory is configured
+   cfg.retained_dir = target_dir / "retained";
+   {
+      block_log target( target_dir, cfg );
+      BOOST_CHECK( !fc::exists( target_dir / "blocks-1-10.log" ) );
+      BOOST_CHECK( fc::exists( cfg.retained_dir / "blocks-1-10.log" ) );
+      BOOST_CHECK( fc::exists( cfg.retained_dir / "blocks-11-20.index" ) );
+      BOOST_CHECK_EQUAL( target.first_block_num(), 1u );
+   }
+
+   // a hard replay keeps the stride files of a retained directory within the blocks directory
+   block_log::repair_log( target_dir, 0, cfg.retained_dir );
+   BOOST_CHECK( fc::exists( cfg.retained_dir / "blocks-1-10.log" ) );
+   block_log repaired( target_dir, cfg );
+   BOOST_CHECK_EQUAL( repaired.first_block_num(), 1u );
+   BOOST_REQUIRE_EQUAL( repaired.head()->id(), source.head()->id() );
+   for( uint32_t n = 1; n <= head_num; ++n ) {
+      BOOST_REQUIRE_EQUAL( repaired.read_block_by_num( n )->id(), source.read_block_by_num( n )->id() );
+   }
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(compressed_blocks) { try {
+   tester chain;
+   chain.produce_blocks(30);
+   chain.close();
+
+   const auto& blocks_dir = chain.get_config().blocks_dir;
+   block_log source( blocks_dir );
+   const auto head_num = source.head()->block_num();
+
+   fc::temp_directory tempdir;
+   const auto target_dir = tempdir.path() / "blocks";
+   block_log_config cfg;
+   cfg.compression = block_log_compression::zlib;
+   {
+      block_log target( target_dir, cfg );
+      target.reset( block_log::extract_genesis_state( blocks_dir ), source.read_block_by_num( 1 ) );
+      for( uint32_t n = 2; n <= head_num; ++n ) {
+         target.append( source.read_block_by_num( n ) );
+      }
+   }
+
+   {
+      std::ifstream log( (target_dir / "blocks.log").generic_string(), std::ios::in | std::ios::binary );
+      uint32_t version = 0;
+      log.read( (char*)&version, sizeof(version) );
+      BOOST_CHECK_EQUAL( version, 3u );
+   }
+
+   // a compressed log can be read without compression configured, through both read paths
+   for( bool mmap_reads : { false, true } ) {
+      block_log_config read_cfg;
+      read_cfg.mmap_reads = mmap_reads;
+      block_log target( target_dir, read_cfg );
+      BOOST_REQUIRE_EQUAL( target.head()->id(), source.head()->id() );
+      for( uint32_t n = 1; n <= head_num; ++n ) {
+         BOOST_REQUIRE_EQUAL( target.read_block_by_num( n )->id(), source.read_block_by_num( n )->id() );
+      }
+   }
+
+   // index reconstruction and repair understand compressed entries
+   fc::remove( target_dir / "blocks.index" );
+   block_log::repair_log( target_dir );
+   block_log repaired( target_dir );
+   BOOST_REQUIRE_EQUAL( repaired.head()->id(), source.head()->id() );
+   for( uint32_t n = 1; n <= head_num; ++n ) {
+      BOOST_REQUIRE_EQUAL( repaired.read_block_by_num( n )->id(), source.read_block_by_num( n )->id() );
+   }
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(parallel_index_reconstruction) { try {
+   tester chain;
+   chain.produce_blocks(50);
+   chain.close();
+
+   const auto& blocks_dir = chain.get_config().blocks_dir;
+   fc::temp_directory tempdir;
+   fc::copy( blocks_dir / "blocks.log", tempdir.path() / "blocks.log" );
+   const auto index_file = tempdir.path() / "blocks.index";
+
+   uint32_t last_verified = 0, total = 0;
+   block_log::construct_index( tempdir.path() / "blocks.log", index_file, 3, [&]( uint32_t verified, uint32_t t ) {
+      BOOST_CHECK_GE( verified, last_verified );
+      last_verified = verified;
+      total = t;
+   } );
+
+   block_log source( blocks_dir );
+   const auto head_num = source.head()->block_num();
+   BOOST_CHECK_EQUAL( total, head_num );
+   BOOST_CHECK_EQUAL( last_verified, head_num );
+   BOOST_REQUIRE_EQUAL( fc::file_size( index_file ), sizeof(uint64_t) * head_num );
+   {
+      block_log rebuilt( tempdir.path() );
+      for( uint32_t n = 1; n <= head_num; ++n ) {
+         BOOST_REQUIRE_EQUAL( rebuilt.get_block_pos( n ), source.get_block_pos( n ) );
+      }
+   }
+
+   // a broken chain of positions is reported and leaves no index behind
+   const uint64_t pos = source.get_block_pos( head_num / 2 );
+   {
+      std::fstream log( (tempdir.path() / "blocks.log").generic_string(), std::ios::in | std::ios::out | std::ios::binary );
+      log.seekp( pos - sizeof(uint64_t) );
+      const uint64_t bad = pos + 1;
+      log.write( (const char*)&bad, sizeof(bad) );
+   }
+   fc::remove( index_file );
+   BOOST_CHECK_THROW( block_log::construct_index( tempdir.path() / "blocks.log", index_file, 2 ), block_log_exception );
+   BOOST_CHECK( !fc::exists( index_file ) );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(async_append) { try {
+   tester chain;
+   chain.produce_blocks(40);
+   chain.close();
+
+   const auto& blocks_dir = chain.get_config().blocks_dir;
+   block_log source( blocks_dir );
+   const auto head_num = source.head()->block_num();
+
+   fc::temp_directory tempdir;
+   block_log_config cfg;
+   cfg.async_append = true;
+   cfg.max_pending_blocks = 4;
+   cfg.fsync_appends = true;
+   cfg.stride = 16;
+   {
+      block_log target( tempdir.path(), cfg );
+      target.reset( block_log::extract_genesis_state( blocks_dir ), source.read_block_by_num( 1 ) );
+      for( uint32_t n = 2; n <= head_num; ++n ) {
+         BOOST_CHECK_EQUAL( target.append( source.read_block_by_num( n ) ), block_log::npos );
+         // queued or written, the block is readable right away
+         BOOST_REQUIRE_EQUAL( target.read_block_by_num( n )->id(), source.read_block_by_num( n )->id() );
+      }
+      BOOST_CHECK_EQUAL( target.head()->id(), source.head()->id() );
+      BOOST_CHECK_THROW( target.append( source.read_block_by_num( 2 ) ), block_log_append_fail );
+
+      target.flush();
+      BOOST_CHECK( fc::exists( tempdir.path() / "blocks-1-16.log" ) );
+      BOOST_CHECK_EQUAL( target.read_head()->id(), source.head()->id() );
+   }
+
+   block_log reopened( tempdir.path() );
+   BOOST_REQUIRE_EQUAL( reopened.head()->id(), source.head()->id() );
+   for( uint32_t n = 1; n <= head_num; ++n ) {
+      BOOST_REQUIRE_EQUAL( reopened.read_block_by_num( n )->id(), source.read_block_by_num( n )->id() );
+   }
+} FC_LOG_AND_RETHROW() }
+
+// irreversible blocks that the writer thread never wrote are kept among the reversible blocks and recovered on restart
+BOOST_AUTO_TEST_CASE(async_append_writer_failure) { try {
+   fc::temp_directory tempdir;
+   auto cfg = validating_tester::default_config();
+   cfg.blocks_dir = tempdir.path() / config::default_blocks_dir_name;
+   cfg.state_dir = tempdir.path() / config::default_state_dir_name;
+   cfg.blog_config.async_append = true;
+
+   std::map<uint32_t, block_id_type> ids;
+   uint32_t lib = 0;
+   {
+      tester chain( cfg );
+      chain.produce_blocks( 10 );
+
+      // a foreign write to blocks.index puts the index at a position the writer does not expect, which kills it
+      bool writer_failed = false;
+      for( int i = 0; i < 50 && !writer_failed; ++i ) {
+         {
+            std::ofstream index( (cfg.blocks_dir / "blocks.index").generic_string(), std::ios::binary | std::ios::app );
+            const uint64_t garbage = 0;
+            index.write( (const char*)&garbage, sizeof(garbage) );
+         }
+         try {
+            chain.produce_block();
+         } catch( const fc::exception& ) {
+            writer_failed = true;
+         }
+      }
+      BOOST_REQUIRE( writer_failed );
+
+      lib = chain.control->last_irreversible_block_num();
+      for( uint32_t n = 1; n <= chain.control->head_block_num(); ++n )
+         ids[n] = chain.control->fetch_block_by_number( n )->id();
+      chain.close();
+   }
+
+   {
+      tester reopened( cfg );
+      BOOST_REQUIRE_GE( reopened.control->last_irreversible_block_num(), lib );
+      for( const auto& id : ids )
+         BOOST_REQUIRE_EQUAL( reopened.control->fetch_block_by_number( id.first )->id(), id.second );
+      reopened.produce_blocks( 5 );
+      reopened.close();
+   }
+
+   // the irreversible blocks are in the block log itself, not just among the reversible blocks
+   block_log blog( cfg.blocks_dir );
+   BOOST_REQUIRE( blog.head() );
+   BOOST_REQUIRE_GE( blog.head()->block_num(), lib );
+   for( uint32_t n = 1; n <= lib; ++n )
+      BOOST_REQUIRE_EQUAL( blog.read_block_by_num( n )->id(), ids[n] );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(block_cache) { try {
+   tester chain;
+   chain.produce_blocks(20);
+   chain.close();
+
+   const auto& blocks_dir = chain.get_config().blocks_dir;
+   block_log source( blocks_dir );
+   const auto head_num = source.head()->block_num();
+   BOOST_CHECK_EQUAL( source.get_cache_stats().misses, 0u ); // disabled by default
+   const auto block_size = fc::raw::pack_size( *source.read_block_by_num( head_num ) );
+
+   block_log_config cfg;
+   cfg.cache_size = block_size * 4;
+   block_log cached( blocks_dir, cfg );
+   auto b = cached.read_block_by_num( head_num );
+   BOOST_CHECK( cached.read_block_by_num( head_num ) == b ); // same instance, not deserialized again
+   auto stats = cached.get_cache_stats();
+   BOOST_CHECK_EQUAL( stats.hits, 1u );
+   BOOST_CHECK_EQUAL( stats.misses, 1u );
+   BOOST_CHECK_EQUAL( stats.blocks, 1u );
+
+   for( uint32_t n = 1; n <= head_num; ++n ) {
+      BOOST_REQUIRE_EQUAL( cached.read_block_by_num( n )->id(), source.read_block_by_num( n )->id() );
+   }
+   stats = cached.get_cache_stats();
+   BOOST_CHECK_LE( stats.size, cfg.cache_size );
+   BOOST_CHECK_GT( stats.blocks, 0u );
+   BOOST_CHECK( cached.read_block_by_num( head_num ) );
+   BOOST_CHECK_EQUAL( cached.get_cache_stats().hits, stats.hits + 1 );
+
+   // blocks of another chain appended under the same numbers replace the cached ones
+   tester other;
+   other.create_account( N(alice) );
+   other.produce_blocks(20);
+   other.close();
+   block_log other_source( other.get_config().blocks_dir );
+   fc::temp_directory tempdir;
+   block_log target( tempdir.path(), cfg );
+   for( const auto* log : { &source, &other_source } ) {
+      target.reset( block_log::extract_genesis_state( blocks_dir ), log->read_block_by_num( 1 ) );
+      for( uint32_t n = 2; n <= head_num; ++n ) {
+         target.append( log->read_block_by_num( n ) );
+      }
+      for( uint32_t n = 1; n <= head_num; ++n ) {
+         BOOST_REQUIRE_EQUAL( target.read_block_by_num( n )->id(), log->read_block_by_num( n )->id() );
+      }
+   }
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(prune_blocks) { try {
+   tester chain;
+   chain.produce_blocks(60);
+   chain.close();
+
+   const auto& blocks_dir = chain.get_config().blocks_dir;
+   block_log source( blocks_dir );
+   const auto head_num = source.head()->block_num();
+
+   fc::temp_directory tempdir;
+   block_log_config cfg;
+   cfg.prune_blocks = 20;
+   cfg.cache_size = 1024*1024;
+   BOOST_CHECK_THROW( block_log( tempdir.path(), cfg ), block_log_exception );
+   cfg.stride = 5;
+   block_log target( tempdir.path(), cfg );
+   target.reset( block_log::extract_genesis_state( blocks_dir ), source.read_block_by_num( 1 ) );
+   for( uint32_t n = 2; n <= head_num; ++n ) {
+      target.append( source.read_block_by_num( n ) );
+      // the window never drops below the configured size and lags by less than two strides of 5 blocks
+      const uint32_t first_needed = n >= cfg.prune_blocks ? n - cfg.prune_blocks + 1 : 1;
+      BOOST_REQUIRE_LE( target.first_block_num(), first_needed );
+      BOOST_REQUIRE_GT( target.first_block_num() + 10, first_needed );
+   }
+
+   const uint32_t first = target.first_block_num();
+   BOOST_CHECK_GT( first, 1u );
+   BOOST_CHECK( !target.read_block_by_num( first - 1 ) );
+   BOOST_CHECK( !fc::exists( tempdir.path() / "blocks-1-5.log" ) );
+   for( uint32_t n = first; n <= head_num; ++n ) {
+      BOOST_REQUIRE_EQUAL( target.read_block_by_num( n )->id(), source.read_block_by_num( n )->id() );
+   }
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(replay_prefetch) { try {
+   tester chain;
+   chain.create_accounts( { N(alice), N(bob) } );
+   chain.produce_blocks(30);
+   chain.close();
+
+   block_log source( chain.get_config().blocks_dir );
+   const auto head_id = source.head()->id();
+
+   // replaying with all checks forces key recovery of the prefetched transactions, with and without concurrent reads
+   for( bool mmap_reads : { false, true } ) {
+      fc::temp_directory tempdir;
+      auto cfg = chain.get_config();
+      cfg.blocks_dir = tempdir.path() / config::default_blocks_dir_name;
+      cfg.state_dir = tempdir.path() / config::default_state_dir_name;
+      cfg.blog_config.mmap_reads = mmap_reads;
+      cfg.force_all_checks = true;
+      cfg.replay_prefetch_blocks = 4;
+      fc::create_directories( cfg.blocks_dir );
+      fc::copy( chain.get_config().blocks_dir / "blocks.log", cfg.blocks_dir / "blocks.log" );
+      fc::copy( chain.get_config().blocks_dir / "blocks.index", cfg.blocks_dir / "blocks.index" );
+
+      tester replayed( cfg );
+      BOOST_CHECK_EQUAL( replayed.control->head_block_id(), head_id );
+      BOOST_CHECK( replayed.control->get_account( N(alice) ).name == N(alice) );
+   }
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_SUITE_END()
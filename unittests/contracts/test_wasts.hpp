@@ -634,6 +634,51 @@ static const char memory_growth_memset_test[] = R"=====(
 )
 )=====";
 
+static const char out_of_bounds_load_wast[] = R"=====(
+(module
+ (export "apply" (func $apply))
+ (memory $0 1)
+ (func $apply (param $0 i64)(param $1 i64)(param $2 i64)
+   (drop (i64.load (i32.const 1048576)))
+ )
+)
+)=====";
+
+static const char memory_reset_wast[] = R"=====(
+(module
+ (import "env" "eosio_assert" (func $eosio_assert (param i32 i32)))
+ (memory $0 2)
+ (data (i32.const 16) "abcdefgh")
+ (data (i32.const 70000) "ABCDEFGH")
+ (export "apply" (func $apply))
+ (func $apply (param $0 i64) (param $1 i64) (param $2 i64)
+   ;; nothing the previous action wrote is left: the data segments, zeros around them, and the minimum size
+   (call $eosio_assert (i64.eq (i64.load (i32.const 16)) (i64.const 7523094288207667809)) (i32.const 0))
+   (call $eosio_assert (i64.eq (i64.load (i32.const 70000)) (i64.const 5208208757389214273)) (i32.const 0))
+   (call $eosio_assert (i64.eqz (i64.load (i32.const 24))) (i32.const 0))
+   (call $eosio_assert (i64.eqz (i64.load (i32.const 4096))) (i32.const 0))
+   (call $eosio_assert (i64.eqz (i64.load (i32.const 65536))) (i32.const 0))
+   (call $eosio_assert (i64.eqz (i64.load (i32.const 70008))) (i32.const 0))
+   (call $eosio_assert (i64.eqz (i64.load (i32.const 131064))) (i32.const 0))
+   (call $eosio_assert (i32.eq (current_memory) (i32.const 2)) (i32.const 0))
+   ;; action 1 reads past the minimum size
+   (if (i64.eq (get_local $2) (i64.const 1)) (then
+     (drop (i64.load (i32.const 131072)))
+   ))
+   ;; overwrite the data segments and the zeros, and grow the memory
+   (i64.store (i32.const 16) (i64.const -1))
+   (i64.store (i32.const 70000) (i64.const -1))
+   (i64.store (i32.const 24) (i64.const -1))
+   (i64.store (i32.const 4096) (i64.const -1))
+   (i64.store (i32.const 65536) (i64.const -1))
+   (i64.store (i32.const 70008) (i64.const -1))
+   (i64.store (i32.const 131064) (i64.const -1))
+   (call $eosio_assert (i32.eq (grow_memory (i32.const 1)) (i32.const 2)) (i32.const 0))
+   (i64.store (i32.const 131072) (i64.const -1))
+ )
+)
+)=====";
+
 static const char large_maligned_host_ptr[] = R"=====(
 (module
  (export "apply" (func $$apply))
@@ -646,4 +691,93 @@ static const char large_maligned_host_ptr[] = R"=====(
    ))
  )
 )
-)=====";
\ No newline at end of file
+)=====";
+static const char table_row_lookups_wast[] = R"=====(
+(module
+ (import "env" "db_store_i64" (func $db_store_i64 (param i64 i64 i64 i64 i32 i32) (result i32)))
+ (import "env" "db_find_i64" (func $db_find_i64 (param i64 i64 i64 i64) (result i32)))
+ (import "env" "db_remove_i64" (func $db_remove_i64 (param i32)))
+ (import "env" "eosio_assert" (func $eosio_assert (param i32 i32)))
+ (import "env" "read_action_data" (func $read_action_data (param i32 i32) (result i32)))
+ (import "env" "send_deferred" (func $send_deferred (param i32 i64 i32 i32 i32)))
+ (memory $0 1)
+ (data (i32.const 32) "row not found\00")
+ (data (i32.const 48) "row found\00")
+ (data (i32.const 64) "action failed\00")
+ (export "apply" (func $apply))
+ (func $find (param $0 i64) (param $1 i64) (result i32)
+   (call $db_find_i64 (get_local $0) (get_local $0) (i64.const 13635070084329242624) (get_local $1))
+ )
+ (func $store (param $0 i64) (param $1 i64)
+   (drop (call $db_store_i64 (get_local $0) (i64.const 13635070084329242624) (get_local $0) (get_local $1) (i32.const 16) (i32.const 8)))
+ )
+ (func $remove (param $0 i64) (param $1 i64)
+   (local $2 i32)
+   (set_local $2 (call $find (get_local $0) (get_local $1)))
+   (call $eosio_assert (i32.ge_s (get_local $2) (i32.const 0)) (i32.const 32))
+   (call $db_remove_i64 (get_local $2))
+ )
+ (func $has (param $0 i64) (param $1 i64)
+   (call $eosio_assert (i32.ge_s (call $find (get_local $0) (get_local $1)) (i32.const 0)) (i32.const 32))
+ )
+ (func $hasnot (param $0 i64) (param $1 i64)
+   (call $eosio_assert (i32.lt_s (call $find (get_local $0) (get_local $1)) (i32.const 0)) (i32.const 48))
+ )
+ (func $apply (param $0 i64) (param $1 i64) (param $2 i64)
+   (local $3 i64)
+   ;; onerror: the row stored by the failed deferred transaction must be gone, then row 3 is stored again
+   (if (i64.eq (get_local $2) (i64.const 11877535737890996224)) (then
+     (call $hasnot (get_local $0) (i64.const 3))
+     (call $store (get_local $0) (i64.const 3))
+     (call $has (get_local $0) (i64.const 3))
+     (return)
+   ))
+   ;; defer: sends the packed transaction in the action data
+   (if (i64.eq (get_local $2) (i64.const 5374671771557429248)) (then
+     (call $send_deferred (i32.const 0) (get_local $0) (i32.const 1024)
+       (call $read_action_data (i32.const 1024) (i32.const 64512)) (i32.const 0))
+     (return)
+   ))
+   ;; fail
+   (if (i64.eq (get_local $2) (i64.const 6457335032905203712)) (then
+     (call $eosio_assert (i32.const 0) (i32.const 64))
+   ))
+   (drop (call $read_action_data (i32.const 16) (i32.const 8)))
+   (set_local $3 (i64.load (i32.const 16)))
+   ;; store, remove, has and hasnot take the primary key of a row of table rows as action data
+   (if (i64.eq (get_local $2) (i64.const 14297087134924800000)) (then
+     (call $store (get_local $0) (get_local $3))
+   ))
+   (if (i64.eq (get_local $2) (i64.const 13449241246161698816)) (then
+     (call $remove (get_local $0) (get_local $3))
+   ))
+   (if (i64.eq (get_local $2) (i64.const 7615586969883508736)) (then
+     (call $has (get_local $0) (get_local $3))
+   ))
+   (if (i64.eq (get_local $2) (i64.const 7615932646031360000)) (then
+     (call $hasnot (get_local $0) (get_local $3))
+   ))
+ )
+)
+)=====";
+
+static const char null_terminated_checks_wast[] = R"=====(
+(module
+ (import "env" "memset" (func $memset (param i32 i32 i32) (result i32)))
+ (import "env" "eosio_assert" (func $eosio_assert (param i32 i32)))
+ (import "env" "read_action_data" (func $read_action_data (param i32 i32) (result i32)))
+ (memory $0 1)
+ (export "apply" (func $apply))
+ (func $apply (param $0 i64) (param $1 i64) (param $2 i64)
+   ;; action data: the address of the message, and whether the last byte of memory terminates it
+   (drop (call $read_action_data (i32.const 0) (i32.const 8)))
+   ;; no terminator from address 8 up to the end of memory
+   (drop (call $memset (i32.const 8) (i32.const 1) (i32.const 65528)))
+   (if (i32.load (i32.const 4)) (then
+     (i32.store8 (i32.const 65535) (i32.const 0))
+   ))
+   ;; fails with the message when it is terminated
+   (call $eosio_assert (i32.const 0) (i32.load (i32.const 0)))
+ )
+)
+)=====";
@@ -0,0 +1,170 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include <eosio/chain/reversible_block_log.hpp>
+#include <eosio/chain/block_log.hpp>
+#include <eosio/testing/tester.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace eosio;
+using namespace eosio::chain;
+using namespace eosio::testing;
+
+BOOST_AUTO_TEST_SUITE(reversible_block_log_tests)
+
+BOOST_AUTO_TEST_CASE(add_remove_reopen) { try {
+   tester chain;
+   chain.produce_blocks(30);
+   chain.close();
+
+   block_log source( chain.get_config().blocks_dir );
+   const auto head_num = source.head()->block_num();
+
+   fc::temp_directory tempdir;
+   const auto file = tempdir.path() / "blocks.ring";
+   {
+      reversible_block_log ring( file, 1024*1024 );
+      BOOST_CHECK( ring.empty() );
+      for( uint32_t n = 1; n <= head_num; ++n ) {
+         ring.add( source.read_block_by_num( n ) );
+      }
+      BOOST_CHECK_EQUAL( ring.first_block_num(), 1u );
+      BOOST_CHECK_EQUAL( ring.last_block_num(), head_num );
+
+      ring.remove_through( 10 );
+      ring.remove_from( head_num - 4 );
+      // a fork switch replaces the removed blocks
+      ring.add( source.read_block_by_num( head_num - 4 ) );
+      BOOST_CHECK_EQUAL( ring.first_block_num(), 11u );
+      BOOST_CHECK_EQUAL( ring.last_block_num(), head_num - 4 );
+   }
+
+   // the removals survive a reopen, read only as well as read write
+   for( bool read_only : { true, false } ) {
+      reversible_block_log ring( file, 1024*1024, read_only );
+      BOOST_REQUIRE_EQUAL( ring.first_block_num(), 11u );
+      BOOST_REQUIRE_EQUAL( ring.last_block_num(), head_num - 4 );
+      BOOST_CHECK( !ring.read_block( 10 ) );
+      BOOST_CHECK( !ring.read_block_id( head_num - 3 ) );
+      for( uint32_t n = 11; n <= head_num - 4; ++n ) {
+         BOOST_REQUIRE_EQUAL( ring.read_block( n )->id(), source.read_block_by_num( n )->id() );
+         BOOST_REQUIRE_EQUAL( *ring.read_block_id( n ), source.read_block_by_num( n )->id() );
+      }
+   }
+
+   // a different capacity rewrites the live blocks into a resized ring
+   reversible_block_log resized( file, 512*1024 );
+   BOOST_CHECK_EQUAL( fc::file_size( file ), 512*1024u );
+   BOOST_REQUIRE_EQUAL( resized.first_block_num(), 11u );
+   BOOST_REQUIRE_EQUAL( resized.last_block_num(), head_num - 4 );
+   BOOST_CHECK_EQUAL( resized.read_block( 11 )->id(), source.read_block_by_num( 11 )->id() );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(wrap_around) { try {
+   tester chain;
+   chain.produce_blocks(60);
+   chain.close();
+
+   block_log source( chain.get_config().blocks_dir );
+   const auto head_num = source.head()->block_num();
+   uint64_t max_block_size = 0;
+   for( uint32_t n = 1; n <= head_num; ++n ) {
+      max_block_size = std::max<uint64_t>( max_block_size, fc::raw::pack_size( *source.read_block_by_num( n ) ) );
+   }
+
+   // room for roughly ten blocks, so the ring wraps several times while five are kept live
+   fc::temp_directory tempdir;
+   const auto file = tempdir.path() / "blocks.ring";
+   const uint64_t capacity = 32 + 10 * (max_block_size + 32);
+   {
+      reversible_block_log ring( file, capacity );
+      for( uint32_t n = 1; n <= head_num; ++n ) {
+         ring.add( source.read_block_by_num( n ) );
+         if( n > 5 )
+            ring.remove_through( n - 5 );
+         BOOST_REQUIRE_EQUAL( ring.read_block( n )->id(), source.read_block_by_num( n )->id() );
+      }
+      BOOST_CHECK_EQUAL( ring.first_block_num(), head_num - 4 );
+   }
+
+   reversible_block_log ring( file, capacity );
+   BOOST_REQUIRE_EQUAL( ring.first_block_num(), head_num - 4 );
+   BOOST_REQUIRE_EQUAL( ring.last_block_num(), head_num );
+   for( uint32_t n = head_num - 4; n <= head_num; ++n ) {
+      BOOST_REQUIRE_EQUAL( ring.read_block( n )->id(), source.read_block_by_num( n )->id() );
+   }
+
+   // without removals the ring fills up instead of overwriting live blocks
+   reversible_block_log full( tempdir.path() / "full.ring", capacity );
+   BOOST_CHECK_THROW( {
+      for( uint32_t n = 1; n <= head_num; ++n )
+         full.add( source.read_block_by_num( n ) );
+   }, reversible_guard_exception );
+   BOOST_CHECK_EQUAL( full.first_block_num(), 1u );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(controller_ring_file_store) { try {
+   fc::temp_directory tempdir;
+   auto cfg = validating_tester::default_config();
+   cfg.blocks_dir = tempdir.path() / config::default_blocks_dir_name;
+   cfg.state_dir = tempdir.path() / config::default_state_dir_name;
+   cfg.reversible_store = reversible_blocks_store::ring_file;
+
+   block_id_type head_id;
+   {
+      tester chain( cfg );
+      chain.produce_blocks(20);
+      head_id = chain.control->head_block_id();
+      BOOST_CHECK( fc::exists( cfg.blocks_dir / config::reversible_blocks_dir_name / config::reversible_blocks_ring_file_name ) );
+      BOOST_CHECK_EQUAL( chain.control->fetch_block_by_number( chain.control->head_block_num() )->id(), head_id );
+   }
+
+   tester reopened( cfg );
+   BOOST_CHECK_EQUAL( reopened.control->head_block_id(), head_id );
+   reopened.produce_blocks(5);
+   BOOST_CHECK_EQUAL( reopened.control->head_block_num(), block_header::num_from_id( head_id ) + 5 );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(controller_imports_reversible_database) { try {
+   fc::temp_directory tempdir;
+   auto cfg = validating_tester::default_config();
+   cfg.blocks_dir = tempdir.path() / config::default_blocks_dir_name;
+   cfg.state_dir = tempdir.path() / config::default_state_dir_name;
+   const auto reversible_dir = cfg.blocks_dir / config::reversible_blocks_dir_name;
+   const auto ring_file = reversible_dir / config::reversible_blocks_ring_file_name;
+
+   block_id_type head_id;
+   {
+      tester chain( cfg );
+      chain.produce_blocks(20);
+      head_id = chain.control->head_block_id();
+   }
+   BOOST_REQUIRE( fc::exists( reversible_dir / "shared_memory.bin" ) );
+
+   cfg.reversible_store = reversible_blocks_store::ring_file;
+
+   // a failed import stops startup and leaves no ring file behind, so that it is attempted again
+   const auto blocker = reversible_dir / "shared_memory.bin.imported";
+   fc::create_directories( blocker / "blocker" );
+   BOOST_CHECK_THROW( tester failed( cfg ), fc::exception );
+   BOOST_CHECK( !fc::exists( ring_file ) );
+   BOOST_CHECK( fc::exists( reversible_dir / "shared_memory.bin" ) );
+   fc::remove_all( blocker );
+
+   {
+      tester imported( cfg );
+      BOOST_CHECK( fc::exists( ring_file ) );
+      BOOST_CHECK( !fc::exists( reversible_dir / "shared_memory.bin" ) );
+      BOOST_CHECK( fc::exists( reversible_dir / "shared_memory.bin.imported" ) );
+      BOOST_CHECK_EQUAL( imported.control->head_block_id(), head_id );
+      BOOST_CHECK_EQUAL( imported.control->fetch_block_by_number( imported.control->head_block_num() )->id(), head_id );
+      imported.produce_blocks(5);
+   }
+
+   tester reopened( cfg );
+   BOOST_CHECK_EQUAL( reopened.control->head_block_num(), block_header::num_from_id( head_id ) + 5 );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_SUITE_END()
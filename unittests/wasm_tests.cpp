@@ -3,6 +3,9 @@
  *  @copyright defined in eos/LICENSE.txt
  */
 #include <array>
+#include <chrono>
+#include <fstream>
+#include <thread>
 #include <utility>
 
 #include <eosio/chain/abi_serializer.hpp>
@@ -66,6 +69,60 @@ struct provereset {
 
 FC_REFLECT_EMPTY(provereset);
 
+/// config of a tester keeping its blocks and state in dir, for the tests of the wasm runtime options
+static controller::config wasm_test_config( const fc::temp_directory& dir ) {
+   auto cfg = validating_tester::default_config();
+   cfg.blocks_dir = dir.path() / config::default_blocks_dir_name;
+   cfg.state_dir = dir.path() / config::default_state_dir_name;
+   return cfg;
+}
+
+/// a transaction of actions of account, with the given names and no data, authorized by its active permission
+static signed_transaction make_actions_trx( const base_tester& chain, account_name account, const vector<uint64_t>& names ) {
+   signed_transaction trx;
+   for( uint64_t n : names ) {
+      action act;
+      act.account = account;
+      act.name = n;
+      act.authorization = vector<permission_level>{{account,config::active_name}};
+      trx.actions.push_back(act);
+   }
+   chain.set_transaction_headers(trx);
+   return trx;
+}
+
+/// signs and pushes make_actions_trx
+static transaction_id_type push_actions( base_tester& chain, account_name account, const vector<uint64_t>& names ) {
+   auto trx = make_actions_trx( chain, account, names );
+   trx.sign( chain.get_private_key( account, "active" ), chain.control->get_chain_id() );
+   chain.push_transaction( trx );
+   return trx.id();
+}
+
+/// the stats of the code account runs, if it is in the instantiation cache
+static optional<wasm_contract_stats> find_contract_stats( const base_tester& chain, account_name account ) {
+   const auto& code_hash = chain.control->db().get<account_metadata_object,by_name>( account ).code_hash;
+   for( const auto& s : chain.control->get_wasm_interface().get_contract_stats() )
+      if( s.code_hash == code_hash )
+         return s;
+   return {};
+}
+
+/// runs actions of account in a block at a time until its code has been compiled again in the background and swapped
+/// in, which happens once it ran tier_up_threshold actions and the compile threads are done with it
+static void run_until_tiered_up( base_tester& chain, account_name account, const vector<uint64_t>& names ) {
+   for( int i = 0; i < 3000; ++i ) {
+      const auto id = push_actions( chain, account, names );
+      chain.produce_blocks(1);
+      BOOST_REQUIRE_EQUAL( transaction_receipt::executed, chain.get_transaction_receipt(id).status );
+      const auto stats = find_contract_stats( chain, account );
+      if( stats && stats->tiered_up )
+         return;
+      std::this_thread::sleep_for( std::chrono::milliseconds(10) );
+   }
+   BOOST_FAIL( "contract was not compiled again" );
+}
+
 BOOST_AUTO_TEST_SUITE(wasm_tests)
 
 /**
@@ -1742,6 +1799,340 @@ BOOST_FIXTURE_TEST_CASE( big_maligned_host_ptr, TESTER ) try {
    produce_blocks(1);
 } FC_LOG_AND_RETHROW()
 
+// null terminated arguments are accepted up to a terminator in the last byte of memory, and rejected when they run
+// off the end of memory or start past it
+BOOST_AUTO_TEST_CASE( null_terminated_checks ) try {
+   for( auto runtime : { wasm_interface::vm_type::wabt, wasm_interface::vm_type::wavm } ) {
+      fc::temp_directory chaindir;
+      auto cfg = wasm_test_config( chaindir );
+      cfg.wasm_runtime = runtime;
+
+      tester chain( cfg );
+      chain.create_accounts( {N(nullterm)} );
+      chain.set_code(N(nullterm), null_terminated_checks_wast);
+      chain.produce_blocks(1);
+
+      auto check_message = [&]( uint32_t ptr, bool terminated ) {
+         signed_transaction trx;
+         trx.actions.emplace_back( vector<permission_level>{{N(nullterm),config::active_name}}, N(nullterm), N(),
+                                   fc::raw::pack( std::make_pair( ptr, uint32_t(terminated) ) ) );
+         chain.set_transaction_headers(trx);
+         trx.sign(chain.get_private_key( N(nullterm), "active" ), chain.control->get_chain_id());
+         chain.push_transaction(trx);
+      };
+
+      const uint32_t memory_size = 64*1024;
+      BOOST_CHECK_THROW( check_message( 8, true ), eosio_assert_message_exception );
+      BOOST_CHECK_THROW( check_message( memory_size - 2, true ), eosio_assert_message_exception );
+      BOOST_CHECK_THROW( check_message( memory_size - 1, true ), eosio_assert_message_exception );
+
+      BOOST_CHECK_THROW( check_message( 8, false ), wasm_execution_error );
+      BOOST_CHECK_THROW( check_message( memory_size - 1, false ), wasm_execution_error );
+      BOOST_CHECK_THROW( check_message( memory_size, true ), wasm_execution_error );
+      BOOST_CHECK_THROW( check_message( memory_size + 1, true ), wasm_execution_error );
+      BOOST_CHECK_THROW( check_message( UINT32_MAX, true ), wasm_execution_error );
+   }
+} FC_LOG_AND_RETHROW()
+
+// machine code stored by one wavm runtime is loaded by the next, and still resolves its globals and intrinsics
+BOOST_AUTO_TEST_CASE( wavm_code_cache ) try {
+   fc::temp_directory tempdir;
+   const auto cache_dir = tempdir.path() / "code_cache";
+
+   auto count_cached = [&]() {
+      uint32_t n = 0;
+      for( fc::directory_iterator itr( cache_dir ), end_itr; itr != end_itr; ++itr )
+         if( fc::path( *itr ).extension().generic_string() == ".o" )
+            ++n;
+      return n;
+   };
+
+   // only the cache's own leftovers of an interrupted write are removed, other files in its directory are kept
+   fc::create_directories( cache_dir );
+   const auto foreign_file = cache_dir / "README";
+   const auto leftover_file = cache_dir / "0123.wavm-code-tmp";
+   for( const auto& f : { foreign_file, leftover_file } )
+      std::ofstream( f.generic_string() ) << "x";
+
+   for( int i = 0; i < 2; ++i ) {
+      fc::temp_directory chaindir;
+      auto cfg = wasm_test_config( chaindir );
+      cfg.wasm_runtime = wasm_interface::vm_type::wavm;
+      cfg.wasm_config.wavm_code_cache_dir = cache_dir;
+
+      tester chain( cfg );
+      chain.create_accounts( {N(globalreset)} );
+      chain.set_code(N(globalreset), mutable_global_wast);
+      chain.produce_blocks(1);
+      const auto id = push_actions( chain, N(globalreset), {0, 1} );
+      chain.produce_blocks(1);
+      BOOST_REQUIRE_EQUAL(true, chain.chain_has_transaction(id));
+      BOOST_CHECK_GE( count_cached(), 1u );
+      BOOST_CHECK( fc::exists( foreign_file ) );
+      BOOST_CHECK( !fc::exists( leftover_file ) );
+   }
+} FC_LOG_AND_RETHROW()
+
+// actions can run in the block that stores their code, while it is still being compiled on the compile threads
+BOOST_AUTO_TEST_CASE( background_compile ) try {
+   fc::temp_directory chaindir;
+   auto cfg = wasm_test_config( chaindir );
+   cfg.wasm_runtime = wasm_interface::vm_type::wavm;
+   cfg.wasm_config.compile_threads = 1;
+
+   tester chain( cfg );
+   chain.create_accounts( {N(globalreset), N(entrycheck)} );
+   chain.produce_blocks(1);
+
+   chain.set_code(N(globalreset), mutable_global_wast);
+   chain.set_code(N(entrycheck), entry_wast);
+   vector<transaction_id_type> ids = { push_actions( chain, N(entrycheck), {0} ), push_actions( chain, N(globalreset), {0} ),
+                                       push_actions( chain, N(globalreset), {1} ) };
+   chain.produce_blocks(1);
+   ids.push_back( push_actions( chain, N(entrycheck), {0} ) );
+   chain.produce_blocks(1);
+
+   for( const auto& id : ids ) {
+      BOOST_REQUIRE_EQUAL(true, chain.chain_has_transaction(id));
+      BOOST_CHECK_EQUAL(transaction_receipt::executed, chain.get_transaction_receipt(id).status);
+   }
+} FC_LOG_AND_RETHROW()
+
+// contracts trapping on the main thread while others are instantiated, evicted and destroyed on the compile threads
+// find the memory they accessed among those of every instance
+BOOST_AUTO_TEST_CASE( trap_during_background_compile ) try {
+   fc::temp_directory chaindir;
+   auto cfg = wasm_test_config( chaindir );
+   cfg.wasm_runtime = wasm_interface::vm_type::wavm;
+   cfg.wasm_config.compile_threads = 1;
+   cfg.wasm_config.instantiation_cache_size = 1;
+
+   tester chain( cfg );
+   chain.create_accounts( {N(oobload), N(compiled)} );
+   chain.set_code(N(oobload), out_of_bounds_load_wast);
+   chain.produce_blocks(1);
+
+   for( int i = 0; i < 50; ++i ) {
+      // a new code hash each time, compiled in the background with its own table and memory
+      chain.set_code( N(compiled), ( "(module (table 8 anyfunc) (memory 2) (export \"apply\" (func $apply))"
+                                     " (func $apply (param i64 i64 i64))"
+                                     " (func (result i32) (i32.const " + std::to_string(i) + ")))" ).c_str() );
+      for( int j = 0; j < 5; ++j )
+         BOOST_CHECK_THROW( push_actions( chain, N(oobload), {uint64_t(i * 5 + j)} ), wasm_execution_error );
+      chain.produce_blocks(1);
+   }
+} FC_LOG_AND_RETHROW()
+
+// the contracts of an incoming transaction are compiled ahead, counted against the instantiation cache size and evicted
+// to stay within it
+BOOST_AUTO_TEST_CASE( incoming_contracts_precompiled ) try {
+   for( uint64_t cache_size : { 512*1024*1024ull, 1ull } ) {
+      fc::temp_directory chaindir;
+      auto cfg = wasm_test_config( chaindir );
+      cfg.wasm_runtime = wasm_interface::vm_type::wavm;
+      cfg.wasm_config.compile_threads = 1;
+      cfg.wasm_config.instantiation_cache_size = cache_size;
+
+      tester chain( cfg );
+      chain.create_accounts( {N(entrycheck)} );
+      chain.set_code(N(entrycheck), entry_wast);
+      chain.produce_blocks(1);
+      // starts over with nothing instantiated
+      chain.close();
+      chain.open( nullptr );
+
+      const auto& wasmif = chain.control->get_wasm_interface();
+      auto cached = [&]() { return bool( find_contract_stats( chain, N(entrycheck) ) ); };
+      BOOST_REQUIRE( !cached() );
+
+      auto trx = make_actions_trx( chain, N(entrycheck), {0} );
+      trx.sign( chain.get_private_key( N(entrycheck), "active" ), chain.control->get_chain_id() );
+      chain.control->precompile_contracts( std::make_shared<transaction_metadata>( trx ) );
+      const auto stats = wasmif.get_cache_stats();
+      if( cache_size > 1 ) {
+         BOOST_CHECK( cached() );
+         BOOST_CHECK_GT( stats.size, 0u );
+      } else {
+         BOOST_CHECK( !cached() );
+         BOOST_CHECK_EQUAL( stats.size, 0u );
+         BOOST_CHECK_EQUAL( stats.evictions, 1u );
+      }
+
+      // nothing is compiled again for a contract already in the cache
+      chain.control->precompile_contracts( std::make_shared<transaction_metadata>( trx ) );
+      BOOST_CHECK_EQUAL( wasmif.get_cache_stats().entries, stats.entries );
+
+      chain.push_transaction( trx );
+      chain.produce_blocks(1);
+   }
+} FC_LOG_AND_RETHROW()
+
+// contracts keep behaving the same when the tiered runtime moves them from the interpreter to the JIT
+BOOST_AUTO_TEST_CASE( tiered_runtime ) try {
+   fc::temp_directory chaindir;
+   auto cfg = wasm_test_config( chaindir );
+   cfg.wasm_runtime = wasm_interface::vm_type::tiered;
+   cfg.wasm_config.tier_up_threshold = 50; // well above the actions of the first check_results
+
+   tester chain( cfg );
+   chain.create_accounts( {N(globalreset)} );
+   chain.set_code(N(globalreset), mutable_global_wast);
+   chain.produce_blocks(1);
+
+   // the same actions succeed and fail before and after the contract moves to the JIT
+   auto check_results = [&]( uint64_t n ) {
+      const auto id = push_actions( chain, N(globalreset), {0, 1, 0, 1} );
+      BOOST_CHECK_THROW( push_actions( chain, N(globalreset), {n} ), eosio_assert_message_exception );
+      chain.produce_blocks(1);
+      BOOST_REQUIRE_EQUAL(true, chain.chain_has_transaction(id));
+      BOOST_REQUIRE_EQUAL(transaction_receipt::executed, chain.get_transaction_receipt(id).status);
+   };
+
+   check_results( 2 );
+   auto stats = find_contract_stats( chain, N(globalreset) );
+   BOOST_REQUIRE( stats );
+   BOOST_CHECK( !stats->tiered_up );
+
+   run_until_tiered_up( chain, N(globalreset), {0, 1} );
+   stats = find_contract_stats( chain, N(globalreset) );
+   BOOST_CHECK_GE( stats->actions, cfg.wasm_config.tier_up_threshold );
+
+   check_results( 3 );
+   BOOST_CHECK( find_contract_stats( chain, N(globalreset) )->tiered_up );
+} FC_LOG_AND_RETHROW()
+
+// each action starts from the module's initial memory, whatever the action before it wrote and however far it grew
+BOOST_AUTO_TEST_CASE( memory_reset ) try {
+   for( auto runtime : { wasm_interface::vm_type::wabt, wasm_interface::vm_type::wavm } ) {
+      fc::temp_directory chaindir;
+      auto cfg = wasm_test_config( chaindir );
+      cfg.wasm_runtime = runtime;
+
+      tester chain( cfg );
+      chain.create_accounts( {N(memreset)} );
+      chain.set_code(N(memreset), memory_reset_wast);
+      chain.produce_blocks(1);
+
+      auto id = push_actions( chain, N(memreset), {0, 0, 0} );
+      chain.produce_blocks(1);
+      BOOST_REQUIRE_EQUAL(transaction_receipt::executed, chain.get_transaction_receipt(id).status);
+
+      // the memory grown by the action before is gone again
+      BOOST_CHECK_THROW( push_actions( chain, N(memreset), {0, 1} ), wasm_execution_error );
+
+      id = push_actions( chain, N(memreset), {2, 2} );
+      chain.produce_blocks(1);
+      BOOST_REQUIRE_EQUAL(transaction_receipt::executed, chain.get_transaction_receipt(id).status);
+   }
+} FC_LOG_AND_RETHROW()
+
+// contracts evicted from the instantiation cache are instantiated again from their injected code, without parsing and
+// injecting them again, and behave as before
+BOOST_AUTO_TEST_CASE( injected_code_cache ) try {
+   for( auto runtime : { wasm_interface::vm_type::wabt, wasm_interface::vm_type::wavm } ) {
+      fc::temp_directory chaindir;
+      auto cfg = wasm_test_config( chaindir );
+      cfg.wasm_runtime = runtime;
+      cfg.wasm_config.instantiation_cache_size = 1; // only the contract being run fits
+
+      tester chain( cfg );
+      chain.create_accounts( {N(globalreset), N(entrycheck)} );
+      chain.set_code(N(globalreset), mutable_global_wast);
+      chain.set_code(N(entrycheck), entry_wast);
+      chain.produce_blocks(1);
+
+      auto check_results = [&]( uint64_t n ) {
+         const auto id = push_actions( chain, N(globalreset), {0, 1} );
+         BOOST_CHECK_THROW( push_actions( chain, N(globalreset), {n} ), eosio_assert_message_exception );
+         chain.produce_blocks(1);
+         BOOST_REQUIRE_EQUAL(transaction_receipt::executed, chain.get_transaction_receipt(id).status);
+      };
+      const auto& wasmif = chain.control->get_wasm_interface();
+
+      check_results( 2 );
+      const auto id = push_actions( chain, N(entrycheck), {0} );
+      chain.produce_blocks(1);
+      BOOST_REQUIRE_EQUAL(transaction_receipt::executed, chain.get_transaction_receipt(id).status);
+      BOOST_REQUIRE( !find_contract_stats( chain, N(globalreset) ) );
+      const auto before = wasmif.get_cache_stats();
+      BOOST_CHECK_GE( before.injections, 2u );
+
+      check_results( 3 );
+      const auto after = wasmif.get_cache_stats();
+      BOOST_CHECK_GT( after.misses, before.misses );
+      BOOST_CHECK_EQUAL( after.injections, before.injections );
+   }
+} FC_LOG_AND_RETHROW()
+
+// contracts that ran tier_up_threshold actions are compiled again at wavm_hot_opt_level and swapped in
+BOOST_AUTO_TEST_CASE( hot_recompile ) try {
+   fc::temp_directory chaindir;
+   auto cfg = wasm_test_config( chaindir );
+   cfg.wasm_runtime = wasm_interface::vm_type::wavm;
+   cfg.wasm_config.wavm_opt_level = 0;
+   cfg.wasm_config.wavm_hot_opt_level = 2;
+   cfg.wasm_config.tier_up_threshold = 3;
+
+   tester chain( cfg );
+   chain.create_accounts( {N(globalreset)} );
+   chain.set_code(N(globalreset), mutable_global_wast);
+   chain.produce_blocks(1);
+
+   push_actions( chain, N(globalreset), {0, 1} );
+   auto stats = find_contract_stats( chain, N(globalreset) );
+   BOOST_REQUIRE( stats );
+   BOOST_CHECK( !stats->tiered_up );
+   const auto first_compile_time = stats->compile_time;
+   BOOST_CHECK( first_compile_time > fc::microseconds() );
+   chain.produce_blocks(1);
+
+   run_until_tiered_up( chain, N(globalreset), {0, 1} );
+   stats = find_contract_stats( chain, N(globalreset) );
+   BOOST_CHECK_GE( stats->actions, cfg.wasm_config.tier_up_threshold );
+   BOOST_CHECK( stats->compile_time > first_compile_time );
+
+   // the module compiled again resets its global between actions like the first one
+   const auto id = push_actions( chain, N(globalreset), {0, 1, 0, 1} );
+   chain.produce_blocks(1);
+   BOOST_REQUIRE_EQUAL(transaction_receipt::executed, chain.get_transaction_receipt(id).status);
+
+   BOOST_CHECK_THROW( wasm_interface( wasm_interface::vm_type::wavm, chain.control->db(), [] {
+      wasm_interface_config c;
+      c.wavm_opt_level = 3;
+      return c;
+   }() ), wasm_exception );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( instantiation_cache_budget ) try {
+   fc::temp_directory chaindir;
+   auto cfg = wasm_test_config( chaindir );
+   cfg.wasm_config.instantiation_cache_size = 1; // only the contract being run fits
+
+   tester chain( cfg );
+   chain.create_accounts( {N(entrycheck), N(globalreset)} );
+   chain.set_code(N(entrycheck), entry_wast);
+   chain.set_code(N(globalreset), mutable_global_wast);
+   chain.produce_blocks(1);
+
+   auto run = [&]( account_name account, uint64_t name ) {
+      const auto id = push_actions( chain, account, {name} );
+      chain.produce_blocks(1);
+      BOOST_REQUIRE_EQUAL(transaction_receipt::executed, chain.get_transaction_receipt(id).status);
+   };
+
+   const auto before = chain.control->get_wasm_interface().get_cache_stats();
+   run( N(entrycheck), 0 );
+   run( N(globalreset), 1 );
+   run( N(entrycheck), 0 );
+   run( N(entrycheck), 0 );
+
+   // each switch of contract instantiates it again and evicts the other one
+   const auto after = chain.control->get_wasm_interface().get_cache_stats();
+   BOOST_CHECK_GE( after.misses - before.misses, 3u );
+   BOOST_CHECK_GE( after.evictions - before.evictions, 2u );
+   BOOST_CHECK_GE( after.hits - before.hits, 1u );
+} FC_LOG_AND_RETHROW()
+
 // TODO: restore net_usage_tests
 #if 0
 BOOST_FIXTURE_TEST_CASE(net_usage_tests, tester ) try {